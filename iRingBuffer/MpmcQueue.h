@@ -0,0 +1,192 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "ringutil.h"
+
+//bounded lock-free multi-producer/multi-consumer queue (Vyukov)
+//every slot carries a sequence number telling which lap of the ring may use it next:
+//  seq == pos      the slot is free for the producer that claims pos
+//  seq == pos + 1  the slot holds the element for the consumer that claims pos
+template <typename T>
+class MpmcQueue {
+public:
+	MpmcQueue(uint32_t size) {
+		if (!is_power_of_two(size))
+			size = roundup_pow_of_two(size);
+
+		m_mask = size - 1;
+		m_cells = new Cell[size];
+		for (uint32_t i = 0; i < size; ++i)
+			m_cells[i].seq.store(i, std::memory_order_relaxed);
+
+		m_enqueuePos.store(0, std::memory_order_relaxed);
+		m_dequeuePos.store(0, std::memory_order_relaxed);
+	}
+
+	~MpmcQueue() {
+		//destroy elements that were never dequeued
+		size_t out = m_dequeuePos.load(std::memory_order_relaxed);
+		size_t in = m_enqueuePos.load(std::memory_order_relaxed);
+		for (; out != in; ++out)
+			m_cells[out & m_mask].ptr()->~T();
+		delete[] m_cells;
+	}
+
+	MpmcQueue(const MpmcQueue&) = delete;
+	MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+	size_t capacity() const { return m_mask + 1; }
+
+	//approximate while producers/consumers are running
+	size_t size() const {
+		size_t in = m_enqueuePos.load(std::memory_order_relaxed);
+		size_t out = m_dequeuePos.load(std::memory_order_relaxed);
+		return in > out ? in - out : 0;
+	}
+
+	bool empty() const { return size() == 0; }
+
+	template <typename... Args>
+	bool try_emplace(Args&&... args) {
+		Cell* cell;
+		size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+		for (;;) {
+			cell = &m_cells[pos & m_mask];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+			if (diff == 0) {
+				if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0) {
+				//full: the slot still holds the element from the previous lap
+				return false;
+			}
+			else {
+				pos = m_enqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+
+		new (cell->ptr()) T(std::forward<Args>(args)...);
+		cell->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool try_enqueue(const T& t) { return try_emplace(t); }
+	bool try_enqueue(T&& t) { return try_emplace(std::move(t)); }
+
+	bool try_dequeue(T& t) {
+		Cell* cell;
+		size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+		for (;;) {
+			cell = &m_cells[pos & m_mask];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+			if (diff == 0) {
+				if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0) {
+				//empty
+				return false;
+			}
+			else {
+				pos = m_dequeuePos.load(std::memory_order_relaxed);
+			}
+		}
+
+		t = std::move(*cell->ptr());
+		cell->ptr()->~T();
+		cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+		return true;
+	}
+
+	//moves up to count elements from first in one claim; returns how many were enqueued
+	template <typename It>
+	size_t try_enqueue_bulk(It first, size_t count) {
+		if (count == 0)
+			return 0;
+
+		size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+		size_t n;
+		for (;;) {
+			//a free slot stays free until enqueuePos moves past it, so checking then claiming is safe
+			n = 0;
+			while (n < count && n <= m_mask && m_cells[(pos + n) & m_mask].seq.load(std::memory_order_acquire) == pos + n)
+				++n;
+
+			if (n == 0) {
+				if ((intptr_t)m_cells[pos & m_mask].seq.load(std::memory_order_acquire) - (intptr_t)pos < 0)
+					return 0;
+				pos = m_enqueuePos.load(std::memory_order_relaxed);
+				continue;
+			}
+
+			if (m_enqueuePos.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+				break;
+		}
+
+		for (size_t i = 0; i < n; ++i, ++first) {
+			Cell* cell = &m_cells[(pos + i) & m_mask];
+			new (cell->ptr()) T(std::move(*first));
+			cell->seq.store(pos + i + 1, std::memory_order_release);
+		}
+		return n;
+	}
+
+	//moves up to count elements to out in one claim; returns how many were dequeued
+	template <typename It>
+	size_t try_dequeue_bulk(It out, size_t count) {
+		if (count == 0)
+			return 0;
+
+		size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+		size_t n;
+		for (;;) {
+			n = 0;
+			while (n < count && n <= m_mask && m_cells[(pos + n) & m_mask].seq.load(std::memory_order_acquire) == pos + n + 1)
+				++n;
+
+			if (n == 0) {
+				if ((intptr_t)m_cells[pos & m_mask].seq.load(std::memory_order_acquire) - (intptr_t)(pos + 1) < 0)
+					return 0;
+				pos = m_dequeuePos.load(std::memory_order_relaxed);
+				continue;
+			}
+
+			if (m_dequeuePos.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+				break;
+		}
+
+		for (size_t i = 0; i < n; ++i, ++out) {
+			Cell* cell = &m_cells[(pos + i) & m_mask];
+			*out = std::move(*cell->ptr());
+			cell->ptr()->~T();
+			cell->seq.store(pos + i + m_mask + 1, std::memory_order_release);
+		}
+		return n;
+	}
+
+private:
+	struct Cell {
+		std::atomic<size_t> seq;
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+		T* ptr() { return reinterpret_cast<T*>(&storage); }
+	};
+
+	char m_pad0[RING_CACHELINE_SIZE];
+	Cell* m_cells;
+	size_t m_mask;
+	char m_pad1[RING_CACHELINE_SIZE];
+	std::atomic<size_t> m_enqueuePos;
+	char m_pad2[RING_CACHELINE_SIZE];
+	std::atomic<size_t> m_dequeuePos;
+	char m_pad3[RING_CACHELINE_SIZE];
+};
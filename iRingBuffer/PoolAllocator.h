@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+#include "MpmcQueue.h"
+
+//lock-free free lists of recycled blocks, one per 64-byte size class, shared by every PoolAllocator<T>
+class PoolBlocks {
+public:
+	static const size_t kClassSize = 64;
+	static const size_t kMaxSize = 512;
+
+	static MpmcQueue<void*>& bucket(size_t cls) {
+		//never destroyed: blocks may still be released during static destruction
+		static MpmcQueue<void*>** buckets = create();
+		return *buckets[cls - 1];
+	}
+
+private:
+	static MpmcQueue<void*>** create() {
+		MpmcQueue<void*>** buckets = new MpmcQueue<void*>*[kMaxSize / kClassSize];
+		for (size_t i = 0; i < kMaxSize / kClassSize; ++i)
+			buckets[i] = new MpmcQueue<void*>(1024);
+		return buckets;
+	}
+};
+
+//allocator that recycles small blocks through PoolBlocks
+//meant for short-lived shared state such as std::promise/std::future (std::allocator_arg) whose
+//allocation and release happen on different threads; blocks above kMaxSize go straight to operator new
+template <typename T>
+class PoolAllocator {
+public:
+	typedef T value_type;
+
+	static const size_t kClassSize = PoolBlocks::kClassSize;
+	static const size_t kMaxSize = PoolBlocks::kMaxSize;
+
+	PoolAllocator() {}
+	template <typename U>
+	PoolAllocator(const PoolAllocator<U>&) {}
+
+	T* allocate(size_t n) {
+		size_t bytes = n * sizeof(T);
+		if (bytes > kMaxSize || alignof(T) > alignof(std::max_align_t))
+			return static_cast<T*>(::operator new(bytes));
+
+		void* p;
+		size_t cls = size_class(bytes);
+		if (!PoolBlocks::bucket(cls).try_dequeue(p))
+			p = ::operator new(cls * kClassSize);
+		return static_cast<T*>(p);
+	}
+
+	void deallocate(T* p, size_t n) {
+		size_t bytes = n * sizeof(T);
+		if (bytes > kMaxSize || alignof(T) > alignof(std::max_align_t)) {
+			::operator delete(p);
+			return;
+		}
+
+		size_t cls = size_class(bytes);
+		if (!PoolBlocks::bucket(cls).try_enqueue(static_cast<void*>(p)))
+			::operator delete(p);
+	}
+
+	template <typename U>
+	bool operator==(const PoolAllocator<U>&) const { return true; }
+	template <typename U>
+	bool operator!=(const PoolAllocator<U>&) const { return false; }
+
+private:
+	//1-based class of a block; zero-byte requests still get a distinct block, so they use the smallest class
+	static size_t size_class(size_t bytes) {
+		return bytes ? (bytes + kClassSize - 1) / kClassSize : 1;
+	}
+};
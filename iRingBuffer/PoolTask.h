@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+//move-only type-erased void() callable with a small inline buffer
+//callables up to kInlineSize bytes (a bound function plus a few arguments and a promise) are stored in place,
+//bigger ones fall back to the heap; unlike std::function it never needs the callable to be copyable
+//the buffer is max_align_t aligned, so the ops pointer in front of it takes a whole alignment unit;
+//kInlineSize leaves exactly that much of the 64 bytes (48 with a 16-byte max_align_t, 56 otherwise)
+class PoolTask {
+public:
+	static const size_t kHeaderSize = alignof(std::max_align_t) > sizeof(void*) ? alignof(std::max_align_t) : sizeof(void*);
+	static const size_t kInlineSize = 64 - kHeaderSize;
+
+	PoolTask() : m_ops(nullptr) {}
+
+	template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, PoolTask>::value>::type>
+	PoolTask(F&& f) : m_ops(nullptr) {
+		emplace(std::forward<F>(f));
+	}
+
+	PoolTask(PoolTask&& other) : m_ops(other.m_ops) {
+		if (m_ops) {
+			m_ops->move(&m_storage, &other.m_storage);
+			other.m_ops = nullptr;
+		}
+	}
+
+	PoolTask& operator=(PoolTask&& other) {
+		if (this != &other) {
+			reset();
+			if (other.m_ops) {
+				other.m_ops->move(&m_storage, &other.m_storage);
+				m_ops = other.m_ops;
+				other.m_ops = nullptr;
+			}
+		}
+		return *this;
+	}
+
+	PoolTask(const PoolTask&) = delete;
+	PoolTask& operator=(const PoolTask&) = delete;
+
+	~PoolTask() { reset(); }
+
+	//replaces the stored callable, constructing the new one in place
+	template <typename F>
+	void emplace(F&& f) {
+		typedef typename std::decay<F>::type Fn;
+
+		reset();
+		construct<Fn>(std::forward<F>(f), std::integral_constant<bool,
+			sizeof(Fn) <= kInlineSize && alignof(Fn) <= alignof(Storage) && std::is_nothrow_move_constructible<Fn>::value>());
+	}
+
+	//destroys the callable (and whatever it captured)
+	void reset() {
+		if (m_ops) {
+			m_ops->destroy(&m_storage);
+			m_ops = nullptr;
+		}
+	}
+
+	explicit operator bool() const { return m_ops != nullptr; }
+
+	void operator()() { m_ops->invoke(&m_storage); }
+
+private:
+	typedef typename std::aligned_storage<kInlineSize, alignof(std::max_align_t)>::type Storage;
+
+	struct Ops {
+		void (*invoke)(void*);
+		void (*move)(void* dst, void* src);
+		void (*destroy)(void*);
+	};
+
+	template <typename Fn>
+	struct InlineOps {
+		static void invoke(void* p) { (*static_cast<Fn*>(p))(); }
+		static void move(void* dst, void* src) {
+			new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+			static_cast<Fn*>(src)->~Fn();
+		}
+		static void destroy(void* p) { static_cast<Fn*>(p)->~Fn(); }
+		static const Ops ops;
+	};
+
+	template <typename Fn>
+	struct HeapOps {
+		static void invoke(void* p) { (**static_cast<Fn**>(p))(); }
+		static void move(void* dst, void* src) { *static_cast<Fn**>(dst) = *static_cast<Fn**>(src); }
+		static void destroy(void* p) { delete *static_cast<Fn**>(p); }
+		static const Ops ops;
+	};
+
+	//picked at compile time, so the inline placement new is never instantiated for a callable that does not fit
+	template <typename Fn, typename F>
+	void construct(F&& f, std::true_type) {
+		new (&m_storage) Fn(std::forward<F>(f));
+		m_ops = &InlineOps<Fn>::ops;
+	}
+
+	template <typename Fn, typename F>
+	void construct(F&& f, std::false_type) {
+		*reinterpret_cast<Fn**>(&m_storage) = new Fn(std::forward<F>(f));
+		m_ops = &HeapOps<Fn>::ops;
+	}
+
+	const Ops* m_ops;
+	Storage m_storage;
+};
+
+static_assert(sizeof(PoolTask) == 64, "PoolTask should fill exactly one cache line");
+
+template <typename Fn>
+const PoolTask::Ops PoolTask::InlineOps<Fn>::ops = { &PoolTask::InlineOps<Fn>::invoke, &PoolTask::InlineOps<Fn>::move, &PoolTask::InlineOps<Fn>::destroy };
+
+template <typename Fn>
+const PoolTask::Ops PoolTask::HeapOps<Fn>::ops = { &PoolTask::HeapOps<Fn>::invoke, &PoolTask::HeapOps<Fn>::move, &PoolTask::HeapOps<Fn>::destroy };
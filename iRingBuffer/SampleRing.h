@@ -0,0 +1,173 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "ringutil.h"
+
+//fixed-record telemetry ring: writers never block (lock-free, see push), the oldest samples are overwritten when full
+//every sample gets a 64-bit sequence number from one fetch_add; the slot is seq & mask as in RingBuffer
+//each slot is a seqlock: version 2*seq+1 while sample seq is being written, 2*seq+2 once it is complete,
+//so readers can tell torn, unfinished and overwritten records apart; a writer that gives up on its slot
+//leaves its sequence in the slot's skip marker so readers do not mistake the missing sample for one in flight
+template <typename T>
+class SampleRing {
+	static_assert(std::is_trivially_copyable<T>::value, "SampleRing samples are copied bytewise");
+
+public:
+	struct Sample {
+		uint64_t seq;
+		uint64_t timestamp;
+		T value;
+	};
+
+	SampleRing(uint32_t size) {
+		if (!is_power_of_two(size))
+			size = roundup_pow_of_two(size);
+
+		m_mask = size - 1;
+		m_slots = new Slot[size];
+		for (uint32_t i = 0; i < size; ++i) {
+			m_slots[i].version.store(0, std::memory_order_relaxed);
+			m_slots[i].skipped.store(0, std::memory_order_relaxed);
+		}
+
+		m_next.store(0, std::memory_order_relaxed);
+		m_dropped.store(0, std::memory_order_relaxed);
+	}
+
+	~SampleRing() { delete[] m_slots; }
+
+	SampleRing(const SampleRing&) = delete;
+	SampleRing& operator=(const SampleRing&) = delete;
+
+	size_t capacity() const { return m_mask + 1; }
+
+	//sequence number the next sample will get
+	uint64_t head() const { return m_next.load(std::memory_order_acquire); }
+
+	//samples a writer gave up on because their slot was still busy with an older lap
+	uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+	//timestamped with steady_clock in nanoseconds
+	bool push(const T& value) {
+		uint64_t now = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+		return push(value, now);
+	}
+
+	//returns false if the sample was dropped
+	//storing a sample is wait-free (one fetch_add, one CAS, plain stores); dropping one is only lock-free:
+	//raising the skip marker retries while writers of other laps of the same slot move it concurrently
+	bool push(const T& value, uint64_t timestamp) {
+		uint64_t seq = m_next.fetch_add(1, std::memory_order_acq_rel);
+		Slot& slot = m_slots[seq & m_mask];
+
+		//only take the slot if it is idle and holds an older lap; a slow writer from an
+		//older lap or a faster one from a newer lap wins and this sample is dropped
+		uint64_t version = slot.version.load(std::memory_order_relaxed);
+		if ((version & 1) || version >= 2 * seq + 1 ||
+			!slot.version.compare_exchange_strong(version, 2 * seq + 1, std::memory_order_relaxed)) {
+			//seq + 1 so 0 means none; never move the marker back if a newer lap already dropped here,
+			//a single exchange could hide a newer lap's drop from readers and stall them
+			uint64_t skipped = slot.skipped.load(std::memory_order_relaxed);
+			while (skipped < seq + 1 && !slot.skipped.compare_exchange_weak(skipped, seq + 1, std::memory_order_release, std::memory_order_relaxed))
+				;
+			m_dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		std::atomic_thread_fence(std::memory_order_release);
+
+		uint64_t words[kWords];
+		words[kWords - 1] = 0;
+		std::memcpy(words, &value, sizeof(T));
+
+		slot.timestamp.store(timestamp, std::memory_order_relaxed);
+		for (size_t i = 0; i < kWords; ++i)
+			slot.words[i].store(words[i], std::memory_order_relaxed);
+
+		slot.version.store(2 * seq + 2, std::memory_order_release);
+		return true;
+	}
+
+	//copies up to count samples with sequence >= seq into out, oldest first, and returns how many were copied
+	//*pNext receives the sequence to pass to the next call; *pLost the number of samples skipped
+	//because they were overwritten (or dropped) before they could be read
+	//stops at the first sample that is still being written, it is returned by a later call
+	size_t readSince(uint64_t seq, Sample* out, size_t count, uint64_t* pNext = nullptr, uint64_t* pLost = nullptr) const {
+		uint64_t head = m_next.load(std::memory_order_acquire);
+		uint64_t lost = 0;
+		size_t n = 0;
+
+		//anything older than one lap behind head is gone
+		if (head > capacity() && seq < head - capacity()) {
+			lost += head - capacity() - seq;
+			seq = head - capacity();
+		}
+
+		for (; seq < head && n < count; ++seq) {
+			const Slot& slot = m_slots[seq & m_mask];
+			uint64_t version = slot.version.load(std::memory_order_acquire);
+
+			//dropped by its writer: the slot still holds an older lap but the sample will never arrive
+			if (version < 2 * seq + 1 && slot.skipped.load(std::memory_order_acquire) == seq + 1) {
+				++lost;
+				continue;
+			}
+
+			//not written yet, or still being written
+			if (version < 2 * seq + 2)
+				break;
+
+			if (version == 2 * seq + 2) {
+				uint64_t words[kWords];
+				Sample& sample = out[n];
+
+				sample.seq = seq;
+				sample.timestamp = slot.timestamp.load(std::memory_order_relaxed);
+				for (size_t i = 0; i < kWords; ++i)
+					words[i] = slot.words[i].load(std::memory_order_relaxed);
+
+				//the copy is only valid if no writer touched the slot meanwhile
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (slot.version.load(std::memory_order_relaxed) == version) {
+					std::memcpy(&sample.value, words, sizeof(T));
+					++n;
+					continue;
+				}
+			}
+
+			//overwritten by a newer lap (before or during the copy)
+			++lost;
+		}
+
+		if (pNext)
+			*pNext = seq;
+		if (pLost)
+			*pLost = lost;
+		return n;
+	}
+
+private:
+	static const size_t kWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	//payload is kept in relaxed atomic words so concurrent reads of a slot being rewritten are well defined
+	struct Slot {
+		std::atomic<uint64_t> version;
+		std::atomic<uint64_t> skipped;
+		std::atomic<uint64_t> timestamp;
+		std::atomic<uint64_t> words[kWords];
+	};
+
+	char m_pad0[RING_CACHELINE_SIZE];
+	Slot* m_slots;
+	size_t m_mask;
+	char m_pad1[RING_CACHELINE_SIZE];
+	std::atomic<uint64_t> m_next;
+	std::atomic<uint64_t> m_dropped;
+	char m_pad2[RING_CACHELINE_SIZE];
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "TaskHandle.h"
+
+//small DAG executor: nodes are void() jobs, edges say which node has to finish before which
+//run() posts the nodes without predecessors; every finished node counts down its successors
+//and posts the ones that reach zero, so no thread ever waits on another node
+//the graph is copied into each run, it can be changed or run again while a run is in flight
+class TaskGraph {
+public:
+	typedef size_t Node;
+
+	//adds a node, it runs once all its predecessors have finished
+	template<typename F>
+	Node add(F&& fn, TaskPriority priority = PRIORITY_NORMAL) {
+		NodeData node;
+		node.fn = std::forward<F>(fn);
+		node.priority = priority;
+		node.predecessors = 0;
+		m_nodes.push_back(std::move(node));
+		return m_nodes.size() - 1;
+	}
+
+	//to waits for from; throws std::out_of_range for an unknown node
+	void precede(Node from, Node to) {
+		if (from >= m_nodes.size() || to >= m_nodes.size())
+			throw std::out_of_range("TaskGraph node out of range");
+
+		m_nodes[from].successors.push_back(to);
+		m_nodes[to].predecessors++;
+	}
+
+	size_t size() const { return m_nodes.size(); }
+
+	//the handle completes when every node has finished; if a node throws, nodes that have not started yet
+	//are skipped and the handle reports the first exception
+	//throws std::logic_error if the edges form a cycle
+	TaskHandle<void> run(ThreadPool& pool) const {
+		check_acyclic();
+
+		std::shared_ptr<Run> run = std::make_shared<Run>(m_nodes, &pool);
+		if (m_nodes.empty()) {
+			run->out->finish();
+			return TaskHandle<void>(&pool, run->out);
+		}
+
+		for (Node i = 0; i < m_nodes.size(); ++i) {
+			if (m_nodes[i].predecessors == 0)
+				Run::post(run, i);
+		}
+		return TaskHandle<void>(&pool, run->out);
+	}
+
+private:
+	struct NodeData {
+		std::function<void()> fn;
+		TaskPriority priority;
+		std::vector<Node> successors;
+		size_t predecessors;
+	};
+
+	struct Run {
+		std::vector<NodeData> nodes;
+		std::unique_ptr<std::atomic<size_t>[]> pending;
+		std::atomic<size_t> remaining;
+		std::atomic<bool> failed;
+		std::exception_ptr error;
+		std::mutex mutex;
+		ThreadPool* pool;
+		std::shared_ptr<TaskState<void>> out;
+
+		Run(const std::vector<NodeData>& n, ThreadPool* p)
+			: nodes(n), pending(new std::atomic<size_t>[n.size()]), remaining(n.size()), failed(false), pool(p),
+			out(std::make_shared<TaskState<void>>()) {
+			for (size_t i = 0; i < nodes.size(); ++i)
+				pending[i].store(nodes[i].predecessors, std::memory_order_relaxed);
+		}
+
+		//the queued nodes hold the run; if the pool destroys them without running, fail the handle
+		~Run() {
+			if (remaining.load(std::memory_order_relaxed) != 0)
+				out->fail(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+		}
+
+		static void post(const std::shared_ptr<Run>& run, Node i) {
+			run->pool->post(run->nodes[i].priority, [run, i]() { execute(run, i); });
+		}
+
+		static void execute(const std::shared_ptr<Run>& run, Node i) {
+			if (!run->failed.load(std::memory_order_relaxed)) {
+				try {
+					run->nodes[i].fn();
+				}
+				catch (...) {
+					std::lock_guard<std::mutex> lock(run->mutex);
+					if (!run->error)
+						run->error = std::current_exception();
+					run->failed.store(true, std::memory_order_relaxed);
+				}
+			}
+
+			//acq_rel hands this node's writes to its successors and to whoever waits on the run
+			for (Node s : run->nodes[i].successors) {
+				if (run->pending[s].fetch_sub(1, std::memory_order_acq_rel) == 1)
+					post(run, s);
+			}
+
+			if (run->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				if (run->error)
+					run->out->fail(run->error);
+				else
+					run->out->finish();
+			}
+		}
+	};
+
+	//Kahn's algorithm: a cycle leaves nodes that never become ready and the run would never complete
+	void check_acyclic() const {
+		std::vector<size_t> pending(m_nodes.size());
+		std::vector<Node> ready;
+		for (Node i = 0; i < m_nodes.size(); ++i) {
+			pending[i] = m_nodes[i].predecessors;
+			if (pending[i] == 0)
+				ready.push_back(i);
+		}
+
+		size_t visited = 0;
+		while (!ready.empty()) {
+			Node i = ready.back();
+			ready.pop_back();
+			++visited;
+			for (Node s : m_nodes[i].successors) {
+				if (--pending[s] == 0)
+					ready.push_back(s);
+			}
+		}
+
+		if (visited != m_nodes.size())
+			throw std::logic_error("TaskGraph has a cycle");
+	}
+
+	std::vector<NodeData> m_nodes;
+};
@@ -0,0 +1,377 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "PoolTask.h"
+#include "ThreadPool.h"
+
+//completion state shared by a TaskHandle and everything chained on it
+//continuations registered before completion run on the completing thread; they are small thunks
+//that only post the real work to the pool, so completing never blocks or recurses deeply
+class TaskStateBase {
+public:
+	TaskStateBase() : m_ready(false) {}
+
+	TaskStateBase(const TaskStateBase&) = delete;
+	TaskStateBase& operator=(const TaskStateBase&) = delete;
+
+	bool ready() const { return m_ready.load(std::memory_order_acquire); }
+
+	void wait() {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cv.wait(lock, [this] { return m_ready.load(std::memory_order_relaxed); });
+	}
+
+	//only meaningful once ready
+	std::exception_ptr error() const { return m_error; }
+
+	//runs k when the state becomes ready, or right away if it already is
+	void subscribe(PoolTask&& k) {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_ready.load(std::memory_order_relaxed)) {
+				m_continuations.push_back(std::move(k));
+				return;
+			}
+		}
+		k();
+	}
+
+	void fail(std::exception_ptr e) {
+		m_error = e;
+		finish();
+	}
+
+	//publishes the stored value (or error) and runs the continuations
+	void finish() {
+		std::vector<PoolTask> continuations;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_ready.store(true, std::memory_order_release);
+			continuations.swap(m_continuations);
+		}
+		m_cv.notify_all();
+
+		for (PoolTask& k : continuations)
+			k();
+	}
+
+private:
+	std::atomic<bool> m_ready;
+	std::exception_ptr m_error;
+	std::vector<PoolTask> m_continuations;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+};
+
+template<typename T>
+class TaskState : public TaskStateBase {
+public:
+	TaskState() : m_hasValue(false) {}
+
+	~TaskState() {
+		if (m_hasValue)
+			value().~T();
+	}
+
+	//stores the result, finish() publishes it
+	template<typename U>
+	void store(U&& v) {
+		new (&m_storage) T(std::forward<U>(v));
+		m_hasValue = true;
+	}
+
+	const T& value() const { return *reinterpret_cast<const T*>(&m_storage); }
+	T& value() { return *reinterpret_cast<T*>(&m_storage); }
+
+private:
+	typename std::aligned_storage<sizeof(T), alignof(T)>::type m_storage;
+	bool m_hasValue;
+};
+
+template<>
+class TaskState<void> : public TaskStateBase {
+};
+
+//the obligation to complete a state, carried by the task posted to fill it
+//if the pool destroys the task without running it (queued at pool destruction) the state fails with
+//broken_promise, like a std::future would, instead of leaving get() waiting forever
+template<typename R>
+class TaskPromise {
+public:
+	explicit TaskPromise(const std::shared_ptr<TaskState<R>>& state) : m_state(state) {}
+
+	TaskPromise(TaskPromise&&) = default;
+	TaskPromise& operator=(TaskPromise&&) = default;
+
+	~TaskPromise() {
+		if (m_state)
+			m_state->fail(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+	}
+
+	//called by the running task, which then owns completing the state
+	std::shared_ptr<TaskState<R>> release() { return std::move(m_state); }
+
+private:
+	std::shared_ptr<TaskState<R>> m_state;
+};
+
+//runs f(args...) and completes state with its result or exception
+template<typename R>
+struct TaskFulfill {
+	template<typename F, typename... A>
+	static void run(TaskState<R>& state, F& f, A&&... args) {
+		std::exception_ptr error;
+		try {
+			state.store(f(std::forward<A>(args)...));
+		}
+		catch (...) {
+			error = std::current_exception();
+		}
+
+		if (error)
+			state.fail(error);
+		else
+			state.finish();
+	}
+};
+
+template<>
+struct TaskFulfill<void> {
+	template<typename F, typename... A>
+	static void run(TaskState<void>& state, F& f, A&&... args) {
+		std::exception_ptr error;
+		try {
+			f(std::forward<A>(args)...);
+		}
+		catch (...) {
+			error = std::current_exception();
+		}
+
+		if (error)
+			state.fail(error);
+		else
+			state.finish();
+	}
+};
+
+//feeds the antecedent's value (if any) to a continuation
+template<typename T>
+struct TaskInvoke {
+	template<typename F>
+	struct Result {
+		typedef decltype(std::declval<F&>()(std::declval<const T&>())) type;
+	};
+
+	template<typename R, typename F>
+	static void run(TaskState<R>& next, F& f, TaskState<T>& prev) {
+		TaskFulfill<R>::run(next, f, static_cast<const T&>(prev.value()));
+	}
+
+	static T get(TaskState<T>& state) { return state.value(); }
+};
+
+template<>
+struct TaskInvoke<void> {
+	template<typename F>
+	struct Result {
+		typedef decltype(std::declval<F&>()()) type;
+	};
+
+	template<typename R, typename F>
+	static void run(TaskState<R>& next, F& f, TaskState<void>&) {
+		TaskFulfill<R>::run(next, f);
+	}
+
+	static void get(TaskState<void>&) {}
+};
+
+//posts fn to pool, or runs it in place for a handle that has no pool (when_all/when_any of nothing)
+template<typename F>
+void task_dispatch(ThreadPool* pool, TaskPriority priority, F&& fn) {
+	if (pool)
+		pool->post(priority, std::forward<F>(fn));
+	else
+		fn();
+}
+
+//result of a task that continuations can be chained on without blocking a worker
+//then() runs the continuation on the pool once this task has finished; if the task failed the continuation
+//is skipped and the exception is passed along the chain
+template<typename T>
+class TaskHandle {
+public:
+	typedef T value_type;
+
+	TaskHandle() : m_pool(nullptr) {}
+	TaskHandle(ThreadPool* pool, const std::shared_ptr<TaskState<T>>& state) : m_pool(pool), m_state(state) {}
+
+	bool valid() const { return m_state != nullptr; }
+	bool ready() const { return m_state->ready(); }
+	ThreadPool* pool() const { return m_pool; }
+	const std::shared_ptr<TaskState<T>>& state() const { return m_state; }
+
+	//blocking; for threads outside the pool, tasks should chain with then() instead
+	void wait() const { m_state->wait(); }
+
+	//blocking like wait(), rethrows the task's exception
+	T get() const {
+		m_state->wait();
+		if (m_state->error())
+			std::rethrow_exception(m_state->error());
+		return TaskInvoke<T>::get(*m_state);
+	}
+
+	//f takes the result (nothing for void) and may return a value of its own
+	template<typename F>
+	auto then(F f, TaskPriority priority = PRIORITY_NORMAL) -> TaskHandle<typename TaskInvoke<T>::template Result<F>::type> {
+		typedef typename TaskInvoke<T>::template Result<F>::type R;
+
+		std::shared_ptr<TaskState<R>> next = std::make_shared<TaskState<R>>();
+		std::weak_ptr<TaskState<T>> weak = m_state;
+		ThreadPool* pool = m_pool;
+
+		//the thunk sits in this state's continuation list, so it only holds it weakly;
+		//it runs from finish() while the state is still alive
+		m_state->subscribe([pool, priority, weak, next, f]() {
+			std::shared_ptr<TaskState<T>> prev = weak.lock();
+			task_dispatch(pool, priority, [prev, promise = TaskPromise<R>(next), f]() mutable {
+				std::shared_ptr<TaskState<R>> next = promise.release();
+				if (!prev)
+					next->fail(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+				else if (prev->error())
+					next->fail(prev->error());
+				else
+					TaskInvoke<T>::run(*next, f, *prev);
+			});
+		});
+		return TaskHandle<R>(pool, next);
+	}
+
+private:
+	ThreadPool* m_pool;
+	std::shared_ptr<TaskState<T>> m_state;
+};
+
+//runs f(args...) on pool and returns a handle to chain on
+template<typename F, typename... Args>
+auto spawn(ThreadPool& pool, TaskPriority priority, F&& f, Args&&... args) -> TaskHandle<decltype(f(args...))> {
+	typedef decltype(f(args...)) R;
+
+	std::shared_ptr<TaskState<R>> state = std::make_shared<TaskState<R>>();
+	auto bound = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
+	pool.post(priority, [promise = TaskPromise<R>(state), bound = std::move(bound)]() mutable {
+		TaskFulfill<R>::run(*promise.release(), bound);
+	});
+	return TaskHandle<R>(&pool, state);
+}
+
+template<typename F, typename... Args>
+auto spawn(ThreadPool& pool, F&& f, Args&&... args) -> TaskHandle<decltype(f(args...))> {
+	return spawn(pool, PRIORITY_NORMAL, std::forward<F>(f), std::forward<Args>(args)...);
+}
+
+template<typename T>
+struct TaskGather {
+	typedef std::vector<T> type;
+
+	static void finish(TaskState<type>& out, const std::vector<std::shared_ptr<TaskState<T>>>& inputs) {
+		type values;
+		values.reserve(inputs.size());
+		for (const auto& input : inputs)
+			values.push_back(input->value());
+		out.store(std::move(values));
+		out.finish();
+	}
+};
+
+template<>
+struct TaskGather<void> {
+	typedef void type;
+
+	static void finish(TaskState<void>& out, const std::vector<std::shared_ptr<TaskState<void>>>&) {
+		out.finish();
+	}
+};
+
+//completes when every handle has: with all the results in order (nothing for void),
+//or with the first exception in order if any of them failed
+template<typename T>
+TaskHandle<typename TaskGather<T>::type> when_all(const std::vector<TaskHandle<T>>& handles) {
+	typedef typename TaskGather<T>::type R;
+
+	struct Join {
+		std::atomic<size_t> pending;
+		std::vector<std::shared_ptr<TaskState<T>>> inputs;
+		std::shared_ptr<TaskState<R>> out;
+	};
+
+	std::shared_ptr<Join> join = std::make_shared<Join>();
+	join->pending.store(handles.size(), std::memory_order_relaxed);
+	join->out = std::make_shared<TaskState<R>>();
+	for (const TaskHandle<T>& handle : handles)
+		join->inputs.push_back(handle.state());
+
+	ThreadPool* pool = handles.empty() ? nullptr : handles.front().pool();
+	if (handles.empty()) {
+		TaskGather<T>::finish(*join->out, join->inputs);
+		return TaskHandle<R>(pool, join->out);
+	}
+
+	//the last input to finish completes the join on its own thread
+	for (const TaskHandle<T>& handle : handles) {
+		handle.state()->subscribe([join]() {
+			if (join->pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+				return;
+
+			for (const auto& input : join->inputs) {
+				if (input->error()) {
+					join->out->fail(input->error());
+					return;
+				}
+			}
+			TaskGather<T>::finish(*join->out, join->inputs);
+		});
+	}
+	return TaskHandle<R>(pool, join->out);
+}
+
+//completes with the index of the first handle to finish (successfully or not)
+//with no handles nothing can finish first, so it fails right away with std::invalid_argument
+template<typename T>
+TaskHandle<size_t> when_any(const std::vector<TaskHandle<T>>& handles) {
+	struct Race {
+		std::atomic<bool> done;
+		std::shared_ptr<TaskState<size_t>> out;
+	};
+
+	std::shared_ptr<Race> race = std::make_shared<Race>();
+	race->done.store(false, std::memory_order_relaxed);
+	race->out = std::make_shared<TaskState<size_t>>();
+	if (handles.empty()) {
+		race->out->fail(std::make_exception_ptr(std::invalid_argument("when_any of no tasks")));
+		return TaskHandle<size_t>(nullptr, race->out);
+	}
+
+	for (size_t i = 0; i < handles.size(); ++i) {
+		handles[i].state()->subscribe([race, i]() {
+			if (!race->done.exchange(true, std::memory_order_acq_rel)) {
+				race->out->store(i);
+				race->out->finish();
+			}
+		});
+	}
+	return TaskHandle<size_t>(handles.empty() ? nullptr : handles.front().pool(), race->out);
+}
@@ -1,18 +1,60 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <functional>
 #include <future>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <stdexcept>
 #include <thread>
 #include <utility>
 #include <vector>
 
-#include "SafeQueue.h"
+#include "MpmcQueue.h"
+#include "PoolAllocator.h"
+#include "PoolTask.h"
+#include "WorkStealingDeque.h"
 
+//scheduling lanes, served in this order
+enum TaskPriority {
+	PRIORITY_CRITICAL = 0,			//latency-critical work, jumps ahead of everything queued
+	PRIORITY_NORMAL = 1,			//default; takes the local deque / work-stealing path
+	PRIORITY_BACKGROUND = 2,		//batch work, runs when nothing else is queued
+	PRIORITY_COUNT = 3,
+};
+
+//set on the future of a task whose deadline passed before a worker got to it
+class TaskExpired : public std::runtime_error {
+public:
+	TaskExpired() : std::runtime_error("task deadline expired") {}
+};
+
+//work-stealing thread pool
+//every worker owns a Chase-Lev deque: tasks submitted from inside a worker go to its own deque (LIFO, cache-warm),
+//idle workers steal from the top of a random victim's deque, tasks submitted from outside go through a global
+//lock-free injection queue; the mutex and condvar are only used to park and wake idle workers
+//tasks are PoolTask nodes recycled through a free list and futures use pooled shared state,
+//so a steady stream of small submits does not touch the heap
+//critical and background tasks get their own global lanes in front of and behind the normal path;
+//a running task is never preempted, so a critical task waits for at most one task per worker
 class ThreadPool {
 public:
-	ThreadPool(const int nthreads) : m_threads(std::vector<std::thread>(nthreads)), m_shutdown(false) {}
+	typedef std::chrono::steady_clock Clock;
+
+	ThreadPool(const int nthreads) : m_shutdown(false), m_threads(std::vector<std::thread>(nthreads)), m_free(1024), m_idle(0), m_expired(0), m_failed(0) {
+		for (int i = 0; i < nthreads; ++i)
+			m_deques.emplace_back(new WorkStealingDeque<Task*>());
+	}
+
+	~ThreadPool() {
+		shutdown();
+		drain();
+	}
 
 	ThreadPool(const ThreadPool&) = delete;
 	ThreadPool(ThreadPool&&) = delete;
@@ -29,7 +71,10 @@ public:
 
 	//waits until threads finish their current task and shutdowns the pool
 	void shutdown() {
-		m_shutdown = true;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_shutdown = true;
+		}
 		m_cv.notify_all();
 
 		for (int i = 0; i < m_threads.size(); ++i) {
@@ -41,45 +86,576 @@ public:
 
 	template<typename F, typename... Args>
 	auto submit(F&& f, Args&& ...args) -> std::future<decltype(f(args...))> {
-		// create a function with bounded parameters ready to execute
-		std::function<decltype(f(args...))()> func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
-		// encapsulate it into a shared ptr in order to be able to copy construct / assign
-		auto task_ptr = std::make_shared<std::packaged_task<decltype(f(args...))()>>(func);
-
-		//wrap packaged task into void function
-		std::function<void()> wrapper_func = [task_ptr]() {
-			(*task_ptr)();
-		};
+		typedef decltype(f(args...)) R;
 
-		//enqueue generic wrapper function
-		m_queue.enqueue(wrapper_func);
+		//shared state comes from the block pool instead of the heap
+		std::promise<R> promise(std::allocator_arg, PoolAllocator<R>());
+		std::future<R> future = promise.get_future();
 
-		//wake up one thread if its waiting
-		m_cv.notify_one();
+		//bind arguments like std::bind does and keep promise and call together in one move-only task
+		auto bound = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
+		schedule(make_task(Call<R, decltype(bound)>(std::move(promise), std::move(bound))));
 
 		//return future from promise
-		return task_ptr->get_future();
+		return future;
+	}
+
+	//fire-and-forget: no promise or future at all; an exception thrown by f is swallowed and counted in failed()
+	//a priority in front picks one of the overloads below, never this one
+	template<typename F, typename... Args>
+	auto post(F&& f, Args&& ...args) -> typename std::enable_if<!std::is_convertible<typename std::decay<F>::type, TaskPriority>::value>::type {
+		schedule(make_task(std::bind(std::forward<F>(f), std::forward<Args>(args)...)));
+	}
+
+	//submit into the given lane; every overload with a priority throws std::out_of_range for one outside the lanes
+	template<typename F, typename... Args>
+	auto submit(TaskPriority priority, F&& f, Args&& ...args) -> std::future<decltype(f(args...))> {
+		typedef decltype(f(args...)) R;
+
+		std::promise<R> promise(std::allocator_arg, PoolAllocator<R>());
+		std::future<R> future = promise.get_future();
+
+		auto bound = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
+		schedule(make_task(Call<R, decltype(bound)>(std::move(promise), std::move(bound))), priority);
+		return future;
+	}
+
+	//submit that must start before deadline: if no worker picked it up by then it is not run
+	//and its future reports TaskExpired; the deadline adds one time_point to the task, so the call still stays
+	//inline in the PoolTask as long as its bound arguments fit in the remaining kInlineSize bytes
+	template<typename F, typename... Args>
+	auto submit(TaskPriority priority, Clock::time_point deadline, F&& f, Args&& ...args) -> std::future<decltype(f(args...))> {
+		typedef decltype(f(args...)) R;
+
+		std::promise<R> promise(std::allocator_arg, PoolAllocator<R>());
+		std::future<R> future = promise.get_future();
+
+		auto bound = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
+		typedef Call<R, decltype(bound)> C;
+		schedule(make_task(Timed<C>(C(std::move(promise), std::move(bound)), deadline)), priority);
+		return future;
+	}
+
+	//post into the given lane
+	template<typename F, typename... Args>
+	auto post(TaskPriority priority, F&& f, Args&& ...args) -> typename std::enable_if<!std::is_convertible<typename std::decay<F>::type, Clock::time_point>::value>::type {
+		schedule(make_task(std::bind(std::forward<F>(f), std::forward<Args>(args)...)), priority);
+	}
+
+	//post that is silently dropped (and counted in expired()) if it cannot start before deadline
+	template<typename F, typename... Args>
+	void post(TaskPriority priority, Clock::time_point deadline, F&& f, Args&& ...args) {
+		auto bound = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
+		typedef Post<decltype(bound)> P;
+		schedule(make_task(Timed<P>(P(std::move(bound)), deadline)), priority);
+	}
+
+	//tasks dropped because their deadline passed while they were queued
+	uint64_t expired() const { return m_expired.load(std::memory_order_relaxed); }
+
+	//posted tasks that ended with an exception; submitted tasks hand theirs to the future instead
+	uint64_t failed() const { return m_failed.load(std::memory_order_relaxed); }
+
+	//submits f(i) for every i in [0, n); tasks are queued kBatch at a time with one queue operation
+	//and one wakeup per batch instead of one per task
+	template<typename F>
+	auto submit_bulk(F f, size_t n) -> std::vector<std::future<decltype(f(size_t()))>> {
+		typedef decltype(f(size_t())) R;
+
+		std::vector<std::future<R>> futures;
+		futures.reserve(n);
+		schedule_n(n, [&](size_t i) {
+			std::promise<R> promise(std::allocator_arg, PoolAllocator<R>());
+			futures.push_back(promise.get_future());
+
+			auto bound = std::bind(f, i);
+			return make_task(Call<R, decltype(bound)>(std::move(promise), std::move(bound)));
+		});
+		return futures;
+	}
+
+	//fire-and-forget submit_bulk; exceptions are swallowed like post's
+	template<typename F>
+	void post_bulk(F f, size_t n) {
+		schedule_n(n, [&](size_t i) { return make_task(std::bind(f, i)); });
+	}
+
+	//calls fn(i) for every i in [begin, end) and returns when all calls are done
+	//the range is handed out in chunks of at least grain indices that shrink as it drains (guided scheduling):
+	//big chunks first for low overhead, small ones at the end so the threads finish together
+	//with participate the calling thread takes chunks too, otherwise it only waits;
+	//the first exception thrown by fn is rethrown here once the remaining chunks are skipped
+	template<typename F>
+	void parallel_for(size_t begin, size_t end, size_t grain, F&& fn, bool participate = true) {
+		run_chunks(begin, end, grain, participate, [&fn](size_t lo, size_t hi, size_t) {
+			for (size_t i = lo; i < hi; ++i)
+				fn(i);
+		});
+	}
+
+	//folds reduce(acc, fn(i)) over [begin, end) chunked like parallel_for
+	//every thread folds its chunks into its own partial starting from identity and the partials are folded
+	//on the caller at the end, so reduce must be associative and commutative
+	template<typename T, typename F, typename R>
+	T parallel_reduce(size_t begin, size_t end, size_t grain, T identity, F&& fn, R&& reduce, bool participate = true) {
+		std::vector<Partial<T>> partials(m_threads.size() + 1, Partial<T>(identity));
+		run_chunks(begin, end, grain, participate, [&](size_t lo, size_t hi, size_t slot) {
+			T acc = partials[slot].value;
+			for (size_t i = lo; i < hi; ++i)
+				acc = reduce(acc, fn(i));
+			partials[slot].value = acc;
+		});
+
+		T result = identity;
+		for (const Partial<T>& partial : partials)
+			result = reduce(result, partial.value);
+		return result;
 	}
 
 private:
+	typedef PoolTask Task;
+
+	//runs the bound call and publishes its result or exception through the promise
+	template<typename R, typename B>
+	struct Call {
+		std::promise<R> promise;
+		B bound;
+
+		Call(std::promise<R>&& p, B&& b) : promise(std::move(p)), bound(std::move(b)) {}
+
+		void operator()() {
+			try {
+				promise.set_value(bound());
+			}
+			catch (...) {
+				promise.set_exception(std::current_exception());
+			}
+		}
+
+		void expire() { promise.set_exception(std::make_exception_ptr(TaskExpired())); }
+	};
+
+	template<typename B>
+	struct Call<void, B> {
+		std::promise<void> promise;
+		B bound;
+
+		Call(std::promise<void>&& p, B&& b) : promise(std::move(p)), bound(std::move(b)) {}
+
+		void operator()() {
+			try {
+				bound();
+				promise.set_value();
+			}
+			catch (...) {
+				promise.set_exception(std::current_exception());
+			}
+		}
+
+		void expire() { promise.set_exception(std::make_exception_ptr(TaskExpired())); }
+	};
+
+	//bound call without a promise; expiring it just drops it
+	template<typename B>
+	struct Post {
+		B bound;
+
+		Post(B&& b) : bound(std::move(b)) {}
+
+		void operator()() { bound(); }
+		void expire() {}
+	};
+
+	//checks the deadline when a worker picks the task up, only tasks that have one pay for the clock read
+	//tasks only run on the pool's own threads, so the expired counter is reached through context() instead of
+	//a pointer: the wrapper costs just the deadline and keeps timed calls inline in the PoolTask
+	template<typename C>
+	struct Timed {
+		C call;
+		Clock::time_point deadline;
+
+		Timed(C&& c, Clock::time_point d) : call(std::move(c)), deadline(d) {}
+
+		void operator()() {
+			if (Clock::now() > deadline) {
+				context().pool->m_expired.fetch_add(1, std::memory_order_relaxed);
+				call.expire();
+			}
+			else {
+				call();
+			}
+		}
+	};
+
+	struct NoArgs {
+		int operator()() { return 0; }
+	};
+	static_assert(sizeof(Timed<Call<int, NoArgs>>) <= PoolTask::kInlineSize, "a timed submit without arguments must not need the heap");
+
+	//takes a recycled task node if there is one
+	template<typename F>
+	Task* make_task(F&& f) {
+		Task* task;
+		if (!m_free.try_dequeue(task))
+			task = new Task();
+		task->emplace(std::forward<F>(f));
+		return task;
+	}
+
+	void recycle(Task* task) {
+		task->reset();
+		if (!m_free.try_enqueue(task))
+			delete task;
+	}
+
+	//which pool and worker the calling thread belongs to, so submits from inside a task stay local
+	struct Context {
+		ThreadPool* pool;
+		int id;
+	};
+
+	static Context& context() {
+		static thread_local Context ctx = { nullptr, -1 };
+		return ctx;
+	}
+
+	//global FIFO per priority; the overflow list (guarded by m_mutex) takes what the bounded queue cannot
+	struct Lane {
+		MpmcQueue<Task*> queue;
+		std::deque<Task*> overflow;
+		std::atomic<int> overflowSize;
+
+		Lane() : queue(1024), overflowSize(0) {}
+
+		bool empty() const { return queue.empty() && overflowSize.load(std::memory_order_relaxed) == 0; }
+	};
+
+	void schedule(Task* task, TaskPriority priority = PRIORITY_NORMAL) {
+		if ((unsigned)priority >= PRIORITY_COUNT) {
+			recycle(task);
+			throw std::out_of_range("ThreadPool priority out of range");
+		}
+
+		Context& ctx = context();
+		Lane& lane = m_lanes[priority];
+		if (priority == PRIORITY_NORMAL && ctx.pool == this) {
+			m_deques[ctx.id]->push(task);
+		}
+		else if (!lane.queue.try_enqueue(task)) {
+			//lane queue is full, rare enough to take the lock
+			std::lock_guard<std::mutex> lock(m_mutex);
+			lane.overflow.push_back(task);
+			lane.overflowSize.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		//pairs with the fence in park(): either we see the idle worker or it sees the task
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		//wake up one thread if its waiting
+		if (m_idle.load(std::memory_order_relaxed) > 0) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_cv.notify_one();
+		}
+	}
+
+	//one parallel_reduce partial per thread; the pad keeps neighbouring values off each other's cache line
+	//(and keeps T = bool out of the packed std::vector<bool>)
+	template<typename T>
+	struct Partial {
+		T value;
+		char pad[RING_CACHELINE_SIZE];
+
+		Partial(const T& v) : value(v) {}
+	};
+
+	//schedule() for n normal tasks at once: one deque pass or one bulk claim on the normal lane, one wakeup
+	void schedule_bulk(Task** tasks, size_t n) {
+		if (n == 0)
+			return;
+
+		Context& ctx = context();
+		if (ctx.pool == this) {
+			for (size_t i = 0; i < n; ++i)
+				m_deques[ctx.id]->push(tasks[i]);
+		}
+		else {
+			Lane& lane = m_lanes[PRIORITY_NORMAL];
+			size_t done = 0;
+			while (done < n) {
+				size_t k = lane.queue.try_enqueue_bulk(tasks + done, n - done);
+				if (k == 0)
+					break;
+				done += k;
+			}
+
+			if (done < n) {
+				std::lock_guard<std::mutex> lock(m_mutex);
+				lane.overflow.insert(lane.overflow.end(), tasks + done, tasks + n);
+				lane.overflowSize.fetch_add((int)(n - done), std::memory_order_relaxed);
+			}
+		}
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (m_idle.load(std::memory_order_relaxed) > 0) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (n > 1)
+				m_cv.notify_all();
+			else
+				m_cv.notify_one();
+		}
+	}
+
+	static const size_t kBatch = 64;
+
+	//builds make(i) for i in [0, n) into a stack batch and schedules kBatch tasks per queue operation
+	template<typename M>
+	void schedule_n(size_t n, M&& make) {
+		Task* batch[kBatch];
+		size_t count = 0;
+		for (size_t i = 0; i < n; ++i) {
+			batch[count++] = make(i);
+			if (count == kBatch) {
+				schedule_bulk(batch, count);
+				count = 0;
+			}
+		}
+		schedule_bulk(batch, count);
+	}
+
+	//range shared by the caller and the helper tasks of one parallel_for/parallel_reduce
+	//helpers keep it alive through a shared_ptr: one queued after the range is done still reads next and finds nothing
+	template<typename Body>
+	struct ChunkState {
+		std::atomic<size_t> next;
+		std::atomic<size_t> done;
+		std::atomic<size_t> slots;
+		std::atomic<bool> failed;
+		size_t end;
+		size_t total;
+		size_t grain;
+		size_t participants;
+		const Body* body;
+		std::exception_ptr error;
+		std::mutex mutex;
+		std::condition_variable cv;
+
+		ChunkState(size_t b, size_t e, size_t g, size_t p, const Body* f)
+			: next(b), done(0), slots(0), failed(false), end(e), total(e - b), grain(g), participants(p), body(f) {}
+
+		//claims chunks until the range is exhausted; body is only touched while chunks remain,
+		//i.e. while the caller is still waiting
+		void work() {
+			size_t slot = slots.fetch_add(1, std::memory_order_relaxed);
+			size_t lo = next.load(std::memory_order_relaxed);
+			for (;;) {
+				size_t chunk;
+				do {
+					if (lo >= end)
+						return;
+					size_t remaining = end - lo;
+					chunk = std::min(remaining, std::max(grain, remaining / (2 * participants)));
+				} while (!next.compare_exchange_weak(lo, lo + chunk, std::memory_order_relaxed));
+
+				if (!failed.load(std::memory_order_relaxed)) {
+					try {
+						(*body)(lo, lo + chunk, slot);
+					}
+					catch (...) {
+						std::lock_guard<std::mutex> lock(mutex);
+						if (!error)
+							error = std::current_exception();
+						failed.store(true, std::memory_order_relaxed);
+					}
+				}
+
+				//release the chunk's writes to the caller
+				if (done.fetch_add(chunk, std::memory_order_acq_rel) + chunk == total) {
+					std::lock_guard<std::mutex> lock(mutex);
+					cv.notify_all();
+				}
+				lo = next.load(std::memory_order_relaxed);
+			}
+		}
+	};
+
+	//runs body(lo, hi, slot) over [begin, end); slot < m_threads.size() + 1 identifies the thread's partial
+	template<typename Body>
+	void run_chunks(size_t begin, size_t end, size_t grain, bool participate, const Body& body) {
+		if (begin >= end)
+			return;
+		if (grain == 0)
+			grain = 1;
+
+		size_t chunks = (end - begin + grain - 1) / grain;
+		size_t helpers = std::min(m_threads.size(), participate ? chunks - 1 : chunks);
+		if (helpers == 0) {
+			//a single chunk is not worth a round trip through the queues
+			body(begin, end, 0);
+			return;
+		}
+
+		std::shared_ptr<ChunkState<Body>> state = std::make_shared<ChunkState<Body>>(
+			begin, end, grain, helpers + (participate ? 1 : 0), &body);
+		post_bulk([state](size_t) { state->work(); }, helpers);
+
+		if (participate)
+			state->work();
+
+		Context& ctx = context();
+		if (ctx.pool == this) {
+			//a worker must not block here: its own deque may hold the helpers, so it runs tasks while it waits
+			uint32_t seed = 2654435761U * (ctx.id + 1);
+			uint32_t tick = 0;
+			Task* task;
+			while (state->done.load(std::memory_order_acquire) < state->total) {
+				if (find(ctx.id, seed, tick, task))
+					execute(task);
+				else
+					std::this_thread::yield();
+			}
+		}
+		else {
+			std::unique_lock<std::mutex> lock(state->mutex);
+			state->cv.wait(lock, [&] { return state->done.load(std::memory_order_acquire) == state->total; });
+		}
+
+		if (state->error)
+			std::rethrow_exception(state->error);
+	}
+
+	//runs a dequeued task and returns it to the free list; an exception escaping a post()ed task must not
+	//unwind the worker (std::terminate) or skip the recycle, so it is dropped and counted
+	void execute(Task* task) {
+		try {
+			(*task)();
+		}
+		catch (...) {
+			m_failed.fetch_add(1, std::memory_order_relaxed);
+		}
+		recycle(task);
+	}
+
+	static const uint32_t kFairness = 16;
+
+	//critical, then normal, then background; to keep the lower lanes from starving, every kFairness-th pick
+	//of a worker looks at background first and the one halfway in between at normal first
+	bool find(int id, uint32_t& seed, uint32_t& tick, Task*& task) {
+		uint32_t turn = tick++ % kFairness;
+		if (turn == 0 && take(PRIORITY_BACKGROUND, task))
+			return true;
+		if (turn == kFairness / 2 && find_normal(id, seed, task))
+			return true;
+
+		return take(PRIORITY_CRITICAL, task) || find_normal(id, seed, task) || take(PRIORITY_BACKGROUND, task);
+	}
+
+	bool take(TaskPriority priority, Task*& task) {
+		Lane& lane = m_lanes[priority];
+		if (lane.queue.try_dequeue(task))
+			return true;
+
+		if (lane.overflowSize.load(std::memory_order_relaxed) > 0) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!lane.overflow.empty()) {
+				task = lane.overflow.front();
+				lane.overflow.pop_front();
+				lane.overflowSize.fetch_sub(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool find_normal(int id, uint32_t& seed, Task*& task) {
+		if (m_deques[id]->pop(task))
+			return true;
+
+		if (take(PRIORITY_NORMAL, task))
+			return true;
+
+		//steal from the other workers starting at a random victim (xorshift)
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+
+		int n = (int)m_deques.size();
+		for (int k = 0, v = seed % n; k < n; ++k, v = (v + 1) % n) {
+			if (v != id && m_deques[v]->steal(task))
+				return true;
+		}
+		return false;
+	}
+
+	bool has_work() const {
+		for (const Lane& lane : m_lanes) {
+			if (!lane.empty())
+				return true;
+		}
+
+		for (const auto& deque : m_deques) {
+			if (!deque->empty())
+				return true;
+		}
+		return false;
+	}
+
+	void park() {
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		m_idle.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		//a steal can fail on a race while work is still queued, so only sleep if everything is empty
+		if (!m_shutdown && !has_work())
+			m_cv.wait(lock);
+
+		m_idle.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	//destroys tasks that never ran, their futures report broken_promise
+	//destroying a task can queue another one (a continuation failing along with it), so repeat until all is empty
+	void drain() {
+		Task* task;
+		bool found = true;
+		while (found) {
+			found = false;
+			for (auto& deque : m_deques) {
+				while (deque->pop(task)) {
+					delete task;
+					found = true;
+				}
+			}
+			for (int priority = 0; priority < PRIORITY_COUNT; ++priority) {
+				while (take((TaskPriority)priority, task)) {
+					delete task;
+					found = true;
+				}
+			}
+		}
+		while (m_free.try_dequeue(task))
+			delete task;
+	}
+
 	class ThreadWorker {
-	public: 
+	public:
 		ThreadWorker(ThreadPool* pool, const int id) : m_pool(pool), m_id(id) {}
 
 		void operator()() {
-			std::function<void()> func;
-			bool dequeued;
+			Context& ctx = context();
+			ctx.pool = m_pool;
+			ctx.id = m_id;
+
+			uint32_t seed = 2654435761U * (m_id + 1);
+			uint32_t tick = 0;
+			Task* task;
 			while (!m_pool->m_shutdown) {
-				{
-					std::unique_lock<std::mutex> lock(m_pool->m_mutex);
-					if (m_pool->m_queue.empty()) {
-						m_pool->m_cv.wait(lock);
-					}
-					dequeued = m_pool->m_queue.dequeue(func);
+				if (m_pool->find(m_id, seed, tick, task)) {
+					m_pool->execute(task);
+					continue;
 				}
 
-				if (dequeued)
-					func();
+				m_pool->park();
 			}
 		}
 
@@ -89,9 +665,14 @@ private:
 	};
 
 private:
-	bool m_shutdown;
-	SafeQueue<std::function<void()>> m_queue;
+	std::atomic<bool> m_shutdown;
 	std::vector<std::thread> m_threads;
+	std::vector<std::unique_ptr<WorkStealingDeque<Task*>>> m_deques;
+	Lane m_lanes[PRIORITY_COUNT];
+	MpmcQueue<Task*> m_free;
+	std::atomic<int> m_idle;
+	std::atomic<uint64_t> m_expired;
+	std::atomic<uint64_t> m_failed;
 	std::mutex m_mutex;
 	std::condition_variable m_cv;
-};
\ No newline at end of file
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ringutil.h"
+
+//Chase-Lev work-stealing deque (Le, Pop, Cohen, Zappa Nardelli 2013 C11 version)
+//the owner thread pushes and pops at the bottom (LIFO), any other thread steals from the top (FIFO)
+//T must be trivially copyable (a task pointer); the ring grows when full, old rings are kept
+//until destruction because a thief may still be reading from them
+template <typename T>
+class WorkStealingDeque {
+public:
+	WorkStealingDeque(uint32_t size = 256) {
+		if (!is_power_of_two(size))
+			size = roundup_pow_of_two(size);
+
+		m_top.store(0, std::memory_order_relaxed);
+		m_bottom.store(0, std::memory_order_relaxed);
+		m_array.store(new Array(size), std::memory_order_relaxed);
+	}
+
+	~WorkStealingDeque() {
+		for (Array* a : m_garbage)
+			delete a;
+		delete m_array.load(std::memory_order_relaxed);
+	}
+
+	WorkStealingDeque(const WorkStealingDeque&) = delete;
+	WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+	//approximate unless called by the owner
+	bool empty() const {
+		int64_t b = m_bottom.load(std::memory_order_relaxed);
+		int64_t t = m_top.load(std::memory_order_relaxed);
+		return b <= t;
+	}
+
+	//owner only
+	void push(T x) {
+		int64_t b = m_bottom.load(std::memory_order_relaxed);
+		int64_t t = m_top.load(std::memory_order_acquire);
+		Array* a = m_array.load(std::memory_order_relaxed);
+
+		if (b - t > a->mask) {
+			Array* bigger = a->grow(t, b);
+			m_garbage.push_back(a);
+			a = bigger;
+			m_array.store(a, std::memory_order_release);
+		}
+
+		a->put(b, x);
+		std::atomic_thread_fence(std::memory_order_release);
+		m_bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	//owner only; returns false when empty
+	bool pop(T& x) {
+		int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+		Array* a = m_array.load(std::memory_order_relaxed);
+		m_bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = m_top.load(std::memory_order_relaxed);
+
+		if (t > b) {
+			m_bottom.store(b + 1, std::memory_order_relaxed);
+			return false;
+		}
+
+		x = a->get(b);
+		if (t == b) {
+			//last element: race the thieves for it
+			bool won = m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+			m_bottom.store(b + 1, std::memory_order_relaxed);
+			return won;
+		}
+		return true;
+	}
+
+	//any thread; returns false when empty or when it lost a race (the caller just tries elsewhere)
+	bool steal(T& x) {
+		int64_t t = m_top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t b = m_bottom.load(std::memory_order_acquire);
+
+		if (t >= b)
+			return false;
+
+		Array* a = m_array.load(std::memory_order_acquire);
+		x = a->get(t);
+		return m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+	}
+
+private:
+	struct Array {
+		int64_t mask;
+		std::atomic<T>* slots;
+
+		Array(int64_t size) : mask(size - 1), slots(new std::atomic<T>[size]) {}
+		~Array() { delete[] slots; }
+
+		void put(int64_t i, T x) { slots[i & mask].store(x, std::memory_order_relaxed); }
+		T get(int64_t i) const { return slots[i & mask].load(std::memory_order_relaxed); }
+
+		Array* grow(int64_t top, int64_t bottom) const {
+			Array* a = new Array((mask + 1) * 2);
+			for (int64_t i = top; i < bottom; ++i)
+				a->put(i, get(i));
+			return a;
+		}
+	};
+
+	char m_pad0[RING_CACHELINE_SIZE];
+	std::atomic<int64_t> m_top;
+	char m_pad1[RING_CACHELINE_SIZE];
+	std::atomic<int64_t> m_bottom;
+	std::atomic<Array*> m_array;
+	std::vector<Array*> m_garbage;
+	char m_pad2[RING_CACHELINE_SIZE];
+};
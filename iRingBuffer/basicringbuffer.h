@@ -0,0 +1,382 @@
+#ifndef BASICRINGBUFFER_H
+#define BASICRINGBUFFER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <type_traits>
+#include <utility>
+#include <mutex>
+#include <condition_variable>
+
+#include "ringutil.h"
+#include "ringbuffer.h"
+
+//堆上的存储, 大小运行时确定
+template <typename IndexT>
+class RingHeapStorage
+{
+public:
+    RingHeapStorage(IndexT nSize)
+    {
+        //和RingBuffer一样, 0按1处理
+        if(!is_power_of_two(nSize))
+            nSize = (IndexT)roundup_pow_of_two64(nSize);
+
+        //取整后超出IndexT的范围时为0
+        assert(nSize);
+
+        //32位程序里uint64_t的大小可能超出地址空间
+        m_pBuffer = (uint64_t)nSize <= SIZE_MAX ? (uint8_t*)malloc((size_t)nSize) : NULL;
+        assert(m_pBuffer);
+
+        m_nSize = nSize;
+    }
+
+    ~RingHeapStorage() { free(m_pBuffer); }
+
+    RingHeapStorage(const RingHeapStorage&) = delete;
+    RingHeapStorage& operator=(const RingHeapStorage&) = delete;
+
+    uint8_t *data() { return m_pBuffer; }
+    IndexT size() const { return m_nSize; }
+
+private:
+    uint8_t *m_pBuffer;
+    IndexT   m_nSize;
+};
+
+//内嵌在对象里的存储, 大小是编译期常量, 取模和拷贝长度的计算可以被折叠
+template <uint32_t N>
+class RingInlineStorage
+{
+    static_assert(is_power_of_two(N), "RingInlineStorage size must be a power of two");
+    static_assert(N <= (1U << 31), "RingInlineStorage size must fit the 32-bit index arithmetic");
+
+public:
+    uint8_t *data() { return m_buffer; }
+    static constexpr uint32_t size() { return N; }
+
+private:
+    alignas(RING_CACHELINE_SIZE) uint8_t m_buffer[N];
+};
+
+//BasicRingBuffer和StaticRingBuffer共用的实现, 存储由Storage提供(data()/size())
+//回环算法和RingBuffer一样: in/out一直加, (in - out)为数据量, in & (size - 1)为偏移
+//唤醒策略同RingBuffer的RING_NOTIFY_WAITER: 数据量够等待者里最小的nMinFill或者缓冲区满了才唤醒
+template <typename IndexT, typename Storage>
+class RingBufferCore
+{
+    static_assert(std::is_unsigned<IndexT>::value, "RingBufferCore index must be an unsigned type");
+
+public:
+    //缓冲区中的一段连续内存, 同RingSpan, 长度用IndexT
+    struct Span
+    {
+        uint8_t *pData;
+        IndexT   nLen;
+    };
+
+    template <typename... Args>
+    explicit RingBufferCore(Args&&... args) : m_storage(std::forward<Args>(args)...)
+    {
+        m_nIn = m_nOut = 0;
+        m_nWaiters = m_nPutWaiters = 0;
+        m_nWaitFill = (IndexT)~(IndexT)0;
+        m_nDropped = m_nOverwritten = 0;
+    }
+
+    RingBufferCore(const RingBufferCore&) = delete;
+    RingBufferCore& operator=(const RingBufferCore&) = delete;
+
+    IndexT put(const void *pFrom, IndexT nSize)
+    {
+        return put(pFrom, nSize, RING_PUT_TRUNCATE);
+    }
+
+    //ePut为RingPut, 空间不够时按ePut处理
+    IndexT put(const void *pFrom, IndexT nSize, int ePut)
+    {
+        const uint8_t *pData = (const uint8_t*)pFrom;
+        IndexT nCap = m_storage.size();
+
+        std::unique_lock<std::mutex> lk(m_mutex);
+
+        IndexT nFree = nCap - used_locked();
+
+        switch(ePut) {
+        case RING_PUT_BLOCK:
+            return put_wait_locked(lk, pData, nSize);
+
+        case RING_PUT_FAIL:
+            if(nSize > nFree) {
+                m_nDropped += nSize;
+                return 0;
+            }
+            break;
+
+        case RING_PUT_OVERWRITE:
+            //比整个缓冲区还大时只保留最后size字节
+            if(nSize > nCap) {
+                m_nOverwritten += nSize - nCap;
+                pData += nSize - nCap;
+                nSize = nCap;
+            }
+            if(nSize > nFree) {
+                m_nOverwritten += nSize - nFree;
+                m_nOut += nSize - nFree;
+            }
+            break;
+
+        default:
+            break;
+        }
+
+        IndexT nLen = write_locked(pData, nSize);
+
+        m_nDropped += nSize - nLen;
+
+        notify_locked();
+
+        return nLen;
+    }
+
+    IndexT get(void *pTo, IndexT nSize)
+    {
+        return get(pTo, nSize, 1);
+    }
+
+    //阻塞直到至少有min(nMinFill, nSize)字节, 再读出最多nSize字节
+    IndexT get(void *pTo, IndexT nSize, IndexT nMinFill)
+    {
+        IndexT nCap = m_storage.size();
+
+        std::unique_lock<std::mutex> lk(m_mutex);
+
+        nMinFill = nMinFill < nSize ? nMinFill : nSize;
+        nMinFill = nMinFill < nCap ? nMinFill : nCap;
+        if(!nMinFill)
+            nMinFill = 1;
+
+        if(used_locked() < nMinFill) {
+            m_nWaiters++;
+            m_nWaitFill = nMinFill < m_nWaitFill ? nMinFill : m_nWaitFill;
+
+            m_cv.wait(lk, [&] { return used_locked() >= nMinFill; });
+
+            if(!--m_nWaiters)
+                m_nWaitFill = (IndexT)~(IndexT)0;
+        }
+
+        return read_locked((uint8_t*)pTo, nSize);
+    }
+
+    //零拷贝写: reserve返回最多nSize字节的空闲空间(最多两段), 写好后commit实际写入的字节数
+    IndexT reserve(IndexT nSize, Span aSpan[2])
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+
+        IndexT nFree = m_storage.size() - used_locked();
+        nSize = nSize < nFree ? nSize : nFree;
+
+        return spans(m_nIn, nSize, aSpan);
+    }
+
+    void commit(IndexT nSize)
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+
+        assert(nSize <= m_storage.size() - used_locked());
+
+        m_nIn += nSize;
+
+        if(nSize)
+            notify_locked();
+    }
+
+    //零拷贝读: peek返回当前所有可读数据(最多两段), 不阻塞; 用完后consume释放
+    IndexT peek(Span aSpan[2])
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+
+        return spans(m_nOut, used_locked(), aSpan);
+    }
+
+    void consume(IndexT nSize)
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+
+        assert(nSize <= used_locked());
+
+        release_locked(nSize);
+    }
+
+    IndexT length()
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+
+        return used_locked();
+    }
+
+    IndexT size() const { return m_storage.size(); }
+
+    //因为空间不够没有写入的字节数
+    uint64_t dropped()
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+
+        return m_nDropped;
+    }
+
+    //RING_PUT_OVERWRITE覆盖掉的字节数
+    uint64_t overwritten()
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+
+        return m_nOverwritten;
+    }
+
+    //清空数据
+    void reset()
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+
+        m_nIn = m_nOut = 0;
+
+        if(m_nPutWaiters)
+            m_cvPut.notify_all();
+    }
+
+private:
+    //IndexT比int窄时减法会先提升成int, 要截回IndexT才能回环
+    IndexT used_locked() const { return (IndexT)(m_nIn - m_nOut); }
+
+    IndexT spans(IndexT nIdx, IndexT nLen, Span aSpan[2])
+    {
+        IndexT nCap  = m_storage.size();
+        IndexT nOff  = nIdx & (nCap - 1);
+        IndexT nPart = nLen < nCap - nOff ? nLen : nCap - nOff;
+
+        aSpan[0].pData = m_storage.data() + nOff;
+        aSpan[0].nLen  = nPart;
+        aSpan[1].pData = m_storage.data();
+        aSpan[1].nLen  = nLen - nPart;
+
+        return nLen;
+    }
+
+    void notify_locked()
+    {
+        if(!m_nWaiters)
+            return;
+
+        //缓冲区满了总是唤醒; 否则数据量要够等待者里最小的nMinFill
+        IndexT nUsed = used_locked();
+        if(nUsed != m_storage.size() && nUsed < m_nWaitFill)
+            return;
+
+        //等待者要求的数据量不同时notify_one可能叫醒一个还不够读的
+        if(m_nWaiters > 1)
+            m_cv.notify_all();
+        else
+            m_cv.notify_one();
+    }
+
+    IndexT write_locked(const uint8_t *pFrom, IndexT nSize)
+    {
+        Span aSpan[2];
+
+        IndexT nFree = m_storage.size() - used_locked();
+        nSize = nSize < nFree ? nSize : nFree;
+
+        spans(m_nIn, nSize, aSpan);
+
+        memcpy(aSpan[0].pData, pFrom, (size_t)aSpan[0].nLen);
+        memcpy(aSpan[1].pData, pFrom + aSpan[0].nLen, (size_t)aSpan[1].nLen);
+
+        m_nIn += nSize;
+
+        return nSize;
+    }
+
+    IndexT read_locked(uint8_t *pTo, IndexT nSize)
+    {
+        Span aSpan[2];
+
+        IndexT nUsed = used_locked();
+        nSize = nSize < nUsed ? nSize : nUsed;
+
+        spans(m_nOut, nSize, aSpan);
+
+        memcpy(pTo, aSpan[0].pData, (size_t)aSpan[0].nLen);
+        memcpy(pTo + aSpan[0].nLen, aSpan[1].pData, (size_t)aSpan[1].nLen);
+
+        release_locked(nSize);
+
+        return nSize;
+    }
+
+    void release_locked(IndexT nSize)
+    {
+        m_nOut += nSize;
+
+        //有生产者因为缓冲区满在等待
+        if(m_nPutWaiters && nSize)
+            m_cvPut.notify_all();
+    }
+
+    IndexT put_wait_locked(std::unique_lock<std::mutex> &lk, const uint8_t *pFrom, IndexT nSize)
+    {
+        IndexT nDone = 0;
+
+        //有多少空间写多少, 写满了才等
+        while(nDone < nSize) {
+            IndexT nLen = write_locked(pFrom + nDone, nSize - nDone);
+            nDone += nLen;
+
+            if(nLen)
+                notify_locked();
+
+            if(nDone == nSize)
+                break;
+
+            m_nPutWaiters++;
+            m_cvPut.wait(lk, [&] { return used_locked() < m_storage.size(); });
+            m_nPutWaiters--;
+        }
+
+        return nDone;
+    }
+
+private:
+    Storage  m_storage;
+
+    IndexT   m_nIn;
+    IndexT   m_nOut;
+
+    uint32_t m_nWaiters;    //阻塞在get上的消费者个数
+    IndexT   m_nWaitFill;   //等待中的消费者要求的最小数据量
+    uint32_t m_nPutWaiters; //阻塞在put上的生产者个数
+    uint64_t m_nDropped;
+    uint64_t m_nOverwritten;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::condition_variable m_cvPut;
+};
+
+//索引类型可选的环形缓冲区(RingBuffer按索引类型模板化), 存储用普通堆内存
+//IndexT为uint64_t时(RingBuffer64)缓冲区和单次读写都可以超过4GB, 长时间录制不用把一条流拆到多个缓冲区
+template <typename IndexT>
+class BasicRingBuffer : public RingBufferCore<IndexT, RingHeapStorage<IndexT> >
+{
+public:
+    BasicRingBuffer(IndexT nSize) : RingBufferCore<IndexT, RingHeapStorage<IndexT> >(nSize) {}
+};
+
+//64位索引的环形缓冲区, 大小可以超过4GB(32位程序里受地址空间限制)
+typedef BasicRingBuffer<uint64_t> RingBuffer64;
+
+#endif // BASICRINGBUFFER_H
@@ -0,0 +1,302 @@
+/*
+ * =====================================================================================
+ *       Filename:  broadcastringbuffer.cpp
+ *
+ *    Description:  单写者/多读者广播环形缓冲区
+ *         Others:  1.与RingBuffer相同: 2的次方大小, (in) & (size - 1)求偏移, unsigned int回环.
+ *                  2.每个读者一个读索引, 数据只写一份; GATE模式下写者的剩余空间由最慢的读者决定,
+ *                    写者缓存最慢的读索引, 只有缓存值不够用时才扫描所有读者.
+ *                  3.DROP模式下写者不看读者, 写之前先发布m_nClaim(要写到哪里), 读者拷贝完数据后再读m_nClaim,
+ *                    m_nClaim - nOut > size说明拷贝期间数据被覆盖了, 读者掉队, 这次读到的数据作废(seqlock).
+ *                  4.读者注册时先占位(JOINING), 再把读索引设为当前写索引并激活; 写者只看ACTIVE的读者.
+ *                  5.DROP模式下读者拷贝时写者可能正在覆盖同一段内存, put/get两边都用relaxed原子操作访问数据
+ *                    (同SampleRing), 拷贝结果虽然可能作废, 但不是数据竞争.
+ * =====================================================================================
+ */
+
+#include "broadcastringbuffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+//取a和b中最小值
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t) && sizeof(std::atomic<uint8_t>) == 1,
+              "ring memory is accessed in place through atomic words");
+
+//把数据写进环形缓冲区, 缓冲区一侧按对齐的8字节字用relaxed原子store, 首尾不对齐的部分按字节
+static void atomic_copy_in(uint8_t *pRing, const uint8_t *pFrom, uint32_t nLen)
+{
+    for(; nLen && ((uintptr_t)pRing & 7); nLen--)
+        ((std::atomic<uint8_t>*)pRing++)->store(*pFrom++, std::memory_order_relaxed);
+
+    for(; nLen >= 8; nLen -= 8, pRing += 8, pFrom += 8) {
+        uint64_t nWord;
+        memcpy(&nWord, pFrom, 8);
+        ((std::atomic<uint64_t>*)pRing)->store(nWord, std::memory_order_relaxed);
+    }
+
+    for(; nLen; nLen--)
+        ((std::atomic<uint8_t>*)pRing++)->store(*pFrom++, std::memory_order_relaxed);
+}
+
+//atomic_copy_in的反方向, 缓冲区一侧用relaxed原子load
+static void atomic_copy_out(uint8_t *pTo, const uint8_t *pRing, uint32_t nLen)
+{
+    for(; nLen && ((uintptr_t)pRing & 7); nLen--)
+        *pTo++ = ((const std::atomic<uint8_t>*)pRing++)->load(std::memory_order_relaxed);
+
+    for(; nLen >= 8; nLen -= 8, pRing += 8, pTo += 8) {
+        uint64_t nWord = ((const std::atomic<uint64_t>*)pRing)->load(std::memory_order_relaxed);
+        memcpy(pTo, &nWord, 8);
+    }
+
+    for(; nLen; nLen--)
+        *pTo++ = ((const std::atomic<uint8_t>*)pRing++)->load(std::memory_order_relaxed);
+}
+
+BroadcastRingBuffer::BroadcastRingBuffer(uint32_t nSize, uint32_t nMaxReaders, int eMode, uint32_t nFlags)
+{
+    if(!is_power_of_two(nSize))
+        nSize = roundup_pow_of_two(nSize);
+
+    ring_alloc(&m_memory, nSize, nFlags);
+    m_pBuffer = m_memory.pBuffer;
+
+    assert(m_pBuffer);
+
+    m_nSize = m_memory.nSize;
+    m_bMirrored = (m_memory.nFlags & RING_ALLOC_MIRRORED) != 0;
+    m_eMode = eMode;
+
+    m_nMaxReaders = nMaxReaders;
+    m_pCursors = new Cursor[nMaxReaders];
+    for(uint32_t i = 0; i < nMaxReaders; i++) {
+        m_pCursors[i].nOut.store(0, std::memory_order_relaxed);
+        m_pCursors[i].nState.store(CURSOR_FREE, std::memory_order_relaxed);
+    }
+
+    m_nIn.store(0, std::memory_order_relaxed);
+    m_nClaim.store(0, std::memory_order_relaxed);
+    m_nOutCache = 0;
+}
+
+BroadcastRingBuffer::~BroadcastRingBuffer()
+{
+    if(m_pBuffer) {
+        ring_free(&m_memory);
+        m_pBuffer = NULL;
+    }
+
+    delete[] m_pCursors;
+}
+
+int BroadcastRingBuffer::addReader()
+{
+    for(uint32_t i = 0; i < m_nMaxReaders; i++) {
+        Cursor &cursor = m_pCursors[i];
+
+        uint32_t nState = CURSOR_FREE;
+        if(!cursor.nState.compare_exchange_strong(nState, CURSOR_JOINING, std::memory_order_acq_rel))
+            continue;
+
+        //激活之后再取一次写索引: 写者在看到ACTIVE之前写入的数据不会被这个读者读到,
+        //看到ACTIVE之后就会按这个读索引(或者更早的值)限制自己
+        cursor.nOut.store(m_nIn.load(std::memory_order_acquire), std::memory_order_relaxed);
+        cursor.nState.store(CURSOR_ACTIVE, std::memory_order_seq_cst);
+        cursor.nOut.store(m_nIn.load(std::memory_order_seq_cst), std::memory_order_release);
+
+        return (int)i;
+    }
+
+    return -1;
+}
+
+void BroadcastRingBuffer::removeReader(int nReader)
+{
+    assert(nReader >= 0 && (uint32_t)nReader < m_nMaxReaders);
+
+    m_pCursors[nReader].nState.store(CURSOR_FREE, std::memory_order_release);
+}
+
+uint32_t BroadcastRingBuffer::min_out()
+{
+    uint32_t nIn = m_nIn.load(std::memory_order_relaxed);
+    uint32_t nMin = nIn;
+
+    //没有读者时所有空间都可以写
+    for(uint32_t i = 0; i < m_nMaxReaders; i++) {
+        Cursor &cursor = m_pCursors[i];
+        if(cursor.nState.load(std::memory_order_acquire) != CURSOR_ACTIVE)
+            continue;
+
+        uint32_t nOut = cursor.nOut.load(std::memory_order_acquire);
+        if(nIn - nOut > nIn - nMin)
+            nMin = nOut;
+    }
+
+    return nMin;
+}
+
+uint32_t BroadcastRingBuffer::reserve(uint32_t nSize, RingSpan aSpan[2])
+{
+    uint32_t nIn = m_nIn.load(std::memory_order_relaxed);
+
+    if(m_eMode == BROADCAST_DROP) {
+        nSize = min(m_nSize, nSize);
+    } else {
+        //先用缓存的最慢读索引计算剩余空间, 不够再扫描所有读者
+        if(m_nSize - (nIn - m_nOutCache) < nSize)
+            m_nOutCache = min_out();
+
+        nSize = min(m_nSize - (nIn - m_nOutCache), nSize);
+    }
+
+    //先发布要覆盖到哪里再写数据, 读者拷贝完后能发现自己读的数据被覆盖了
+    if(nSize) {
+        m_nClaim.store(nIn + nSize, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    return ring_spans(m_pBuffer, m_nSize, nIn, nSize, aSpan, m_bMirrored);
+}
+
+void BroadcastRingBuffer::commit(uint32_t nSize)
+{
+    uint32_t nIn = m_nIn.load(std::memory_order_relaxed);
+
+    assert(nSize <= m_nClaim.load(std::memory_order_relaxed) - nIn);
+
+    m_nIn.store(nIn + nSize, std::memory_order_release);
+
+    //少写的部分不再算在占用中
+    m_nClaim.store(nIn + nSize, std::memory_order_relaxed);
+}
+
+uint32_t BroadcastRingBuffer::put(const void *pFrom, uint32_t nSize)
+{
+    RingSpan aSpan[2];
+
+    nSize = reserve(nSize, aSpan);
+    if(!nSize)
+        return 0;
+
+    if(m_eMode == BROADCAST_DROP) {
+        atomic_copy_in(aSpan[0].pData, (const uint8_t*)pFrom, aSpan[0].nLen);
+        atomic_copy_in(aSpan[1].pData, (const uint8_t*)pFrom + aSpan[0].nLen, aSpan[1].nLen);
+    } else {
+        memcpy(aSpan[0].pData, pFrom, aSpan[0].nLen);
+        memcpy(aSpan[1].pData, (const uint8_t*)pFrom + aSpan[0].nLen, aSpan[1].nLen);
+    }
+
+    commit(nSize);
+
+    return nSize;
+}
+
+bool BroadcastRingBuffer::validate(Cursor &cursor, uint32_t nOut, uint32_t nSize)
+{
+    //GATE模式下写者不会覆盖没读的数据
+    if(m_eMode != BROADCAST_DROP)
+        return true;
+
+    //数据拷贝完之后再看写者声明要覆盖到哪里
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint32_t nClaim = m_nClaim.load(std::memory_order_relaxed);
+
+    if(nClaim - nOut <= m_nSize && nClaim - nOut >= nSize)
+        return true;
+
+    cursor.nState.store(CURSOR_LAGGED, std::memory_order_release);
+
+    return false;
+}
+
+uint32_t BroadcastRingBuffer::get(int nReader, void *pTo, uint32_t nSize)
+{
+    RingSpan aSpan[2];
+
+    nSize = min(peek(nReader, aSpan), nSize);
+    if(!nSize)
+        return 0;
+
+    uint32_t nLen = min(aSpan[0].nLen, nSize);
+
+    //DROP模式下这段内存可能正被写者覆盖, 用原子load拷贝, 由consume判断结果是否有效
+    if(m_eMode == BROADCAST_DROP) {
+        atomic_copy_out((uint8_t*)pTo, aSpan[0].pData, nLen);
+        atomic_copy_out((uint8_t*)pTo + nLen, aSpan[1].pData, nSize - nLen);
+    } else {
+        memcpy(pTo, aSpan[0].pData, nLen);
+        memcpy((uint8_t*)pTo + nLen, aSpan[1].pData, nSize - nLen);
+    }
+
+    return consume(nReader, nSize) ? nSize : 0;
+}
+
+uint32_t BroadcastRingBuffer::peek(int nReader, RingSpan aSpan[2])
+{
+    assert(nReader >= 0 && (uint32_t)nReader < m_nMaxReaders);
+
+    Cursor &cursor = m_pCursors[nReader];
+    uint32_t nOut = cursor.nOut.load(std::memory_order_relaxed);
+    uint32_t nIn  = m_nIn.load(std::memory_order_acquire);
+
+    if(cursor.nState.load(std::memory_order_relaxed) != CURSOR_ACTIVE)
+        return ring_spans(m_pBuffer, m_nSize, nOut, 0, aSpan, m_bMirrored);
+
+    //已经被套圈
+    if(nIn - nOut > m_nSize) {
+        cursor.nState.store(CURSOR_LAGGED, std::memory_order_release);
+        return ring_spans(m_pBuffer, m_nSize, nOut, 0, aSpan, m_bMirrored);
+    }
+
+    return ring_spans(m_pBuffer, m_nSize, nOut, nIn - nOut, aSpan, m_bMirrored);
+}
+
+bool BroadcastRingBuffer::consume(int nReader, uint32_t nSize)
+{
+    assert(nReader >= 0 && (uint32_t)nReader < m_nMaxReaders);
+
+    Cursor &cursor = m_pCursors[nReader];
+    uint32_t nOut = cursor.nOut.load(std::memory_order_relaxed);
+
+    assert(nSize <= m_nIn.load(std::memory_order_relaxed) - nOut);
+
+    if(!validate(cursor, nOut, nSize))
+        return false;
+
+    //数据读完后再释放空间给写者
+    cursor.nOut.store(nOut + nSize, std::memory_order_release);
+
+    return true;
+}
+
+bool BroadcastRingBuffer::lagged(int nReader)
+{
+    assert(nReader >= 0 && (uint32_t)nReader < m_nMaxReaders);
+
+    return m_pCursors[nReader].nState.load(std::memory_order_acquire) == CURSOR_LAGGED;
+}
+
+void BroadcastRingBuffer::resync(int nReader)
+{
+    assert(nReader >= 0 && (uint32_t)nReader < m_nMaxReaders);
+
+    Cursor &cursor = m_pCursors[nReader];
+
+    cursor.nOut.store(m_nIn.load(std::memory_order_acquire), std::memory_order_release);
+    cursor.nState.store(CURSOR_ACTIVE, std::memory_order_release);
+}
+
+uint32_t BroadcastRingBuffer::length(int nReader)
+{
+    assert(nReader >= 0 && (uint32_t)nReader < m_nMaxReaders);
+
+    uint32_t nOut = m_pCursors[nReader].nOut.load(std::memory_order_acquire);
+    uint32_t nIn  = m_nIn.load(std::memory_order_acquire);
+
+    return min(nIn - nOut, m_nSize);
+}
@@ -0,0 +1,97 @@
+#ifndef BROADCASTRINGBUFFER_H
+#define BROADCASTRINGBUFFER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+#include <atomic>
+
+#include "ringutil.h"
+#include "ringmemory.h"
+
+//读者跟不上时写者的处理方式
+enum BroadcastMode
+{
+    BROADCAST_GATE = 0, //写者受最慢的读者限制, 空间不够时少写(默认)
+    BROADCAST_DROP = 1, //写者从不等待, 被套圈的读者标记为掉队, resync后从最新位置继续
+};
+
+//单写者/多读者广播环形缓冲区, 无锁
+//每个读者有自己的读索引, 同一份数据只存一份, 所有读者都能读到
+//put/reserve/commit只能在一个写者线程调用, 每个读者id只能在一个线程里使用
+class BroadcastRingBuffer
+{
+public:
+    //nMaxReaders为最多同时注册的读者个数, eMode为BroadcastMode
+    BroadcastRingBuffer(uint32_t nSize, uint32_t nMaxReaders, int eMode = BROADCAST_GATE, uint32_t nFlags = RING_ALLOC_HEAP);
+    ~BroadcastRingBuffer();
+
+    BroadcastRingBuffer(const BroadcastRingBuffer&) = delete;
+    BroadcastRingBuffer& operator=(const BroadcastRingBuffer&) = delete;
+
+    //注册读者, 从注册之后写入的数据开始读; 读者满了返回-1
+    int addReader();
+    void removeReader(int nReader);
+
+    //写者线程: 写入min(剩余空间, nSize)字节, 不阻塞; DROP模式下剩余空间总是整个缓冲区
+    //DROP模式下读者可能和写者同时访问同一段数据, 只有put/get按原子字访问, 没有数据竞争;
+    //reserve/commit和peek/consume直接把内存交给调用者, DROP模式下调用者要自己用原子操作访问
+    uint32_t put(const void *pFrom, uint32_t nSize);
+    uint32_t reserve(uint32_t nSize, RingSpan aSpan[2]);
+    void commit(uint32_t nSize);
+
+    //读者线程: 读出min(已有数据, nSize)字节, 不阻塞; 为空或者已经掉队返回0
+    uint32_t get(int nReader, void *pTo, uint32_t nSize);
+
+    //读者线程: 零拷贝读; DROP模式下数据可能在使用期间被覆盖, consume返回false表示这次读到的数据无效并且读者已经掉队
+    uint32_t peek(int nReader, RingSpan aSpan[2]);
+    bool consume(int nReader, uint32_t nSize);
+
+    //DROP模式下读者是否被套圈, 掉队后resync跳到最新位置继续读
+    bool lagged(int nReader);
+    void resync(int nReader);
+
+    uint32_t length(int nReader);
+    uint32_t size() { return m_nSize; }
+
+private:
+    enum
+    {
+        CURSOR_FREE    = 0,
+        CURSOR_JOINING = 1,
+        CURSOR_ACTIVE  = 2,
+        CURSOR_LAGGED  = 3,
+    };
+
+    //每个读者的索引独占一个缓存行, 读者之间互不干扰
+    struct Cursor
+    {
+        std::atomic<uint32_t> nOut;
+        std::atomic<uint32_t> nState;
+        char pad[RING_CACHELINE_SIZE - 2 * sizeof(uint32_t)];
+    };
+
+    uint32_t min_out();
+    bool validate(Cursor &cursor, uint32_t nOut, uint32_t nSize);
+
+private:
+    uint8_t  *m_pBuffer = NULL;
+    uint32_t m_nSize;
+    bool     m_bMirrored;
+    RingMemory m_memory;
+    int      m_eMode;
+
+    Cursor   *m_pCursors;
+    uint32_t m_nMaxReaders;
+
+    char m_pad0[RING_CACHELINE_SIZE];
+
+    //写者独占: m_nClaim为正在写的区域的末尾, 写之前先发布, 读者拷贝完数据后据此判断是否被覆盖(seqlock)
+    std::atomic<uint32_t> m_nIn;
+    std::atomic<uint32_t> m_nClaim;
+    uint32_t m_nOutCache;
+
+    char m_pad1[RING_CACHELINE_SIZE];
+};
+
+#endif // BROADCASTRINGBUFFER_H
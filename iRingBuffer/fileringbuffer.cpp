@@ -0,0 +1,423 @@
+/*
+ * =====================================================================================
+ *       Filename:  fileringbuffer.cpp
+ *
+ *    Description:  内存映射文件做存储的持久化环形缓冲区
+ *         Others:  1.文件布局: [FileRingHeader][填充到FILERING_DATA_OFFSET][数据区nSize].
+ *                  2.索引写在头部的两个槽里, 每次更新写序号更大的下一个槽并带校验值;
+ *                    恢复时取校验通过且序号最大的槽, 最后一次更新写了一半也能退回上一次完整的索引.
+ *                  3.数据先写进映射再更新索引; FILERING_SYNC_COMMIT时先刷数据页再刷头部,
+ *                    断电后磁盘上的索引不会指向没落盘的数据.
+ *                  4.进程崩溃时映射的脏页仍然在系统页缓存里, 三种策略都不丢数据; 策略只影响断电.
+ *                  5.POSIX下用open + mmap + msync; Windows下用CreateFileMapping + FlushViewOfFile + FlushFileBuffers.
+ * =====================================================================================
+ */
+
+#include "fileringbuffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+//取a和b中最小值
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+
+//索引槽的校验值(FNV-1a), 全0的槽校验不通过
+static uint32_t index_check(const FileRingIndex *pIndex)
+{
+    uint32_t aWord[3] = { pIndex->nSeq, pIndex->nIn, pIndex->nOut };
+    const uint8_t *p = (const uint8_t*)aWord;
+    uint32_t nHash = 2166136261U ^ FILERING_MAGIC;
+
+    for(size_t i = 0; i < sizeof(aWord); i++) {
+        nHash ^= p[i];
+        nHash *= 16777619U;
+    }
+
+    return nHash;
+}
+
+//头部的固定字段是否有效
+static bool header_valid(const FileRingHeader *pHeader, uint64_t nFileSize)
+{
+    return pHeader->nMagic == FILERING_MAGIC &&
+           pHeader->nVersion == FILERING_VERSION &&
+           pHeader->nDataOffset == FILERING_DATA_OFFSET &&
+           is_power_of_two(pHeader->nSize) &&
+           (uint64_t)pHeader->nDataOffset + pHeader->nSize <= nFileSize;
+}
+
+FileRingBuffer::FileRingBuffer()
+{
+    m_nMapSize = 0;
+    m_nSize = 0;
+    m_bRecovered = false;
+#ifdef _WIN32
+    m_hFile = INVALID_HANDLE_VALUE;
+    m_hMapping = NULL;
+#else
+    m_fd = -1;
+#endif
+    m_nIn = m_nOut = m_nSeq = 0;
+    m_eSync = FILERING_SYNC_NONE;
+    m_interval = std::chrono::milliseconds(0);
+}
+
+FileRingBuffer::~FileRingBuffer()
+{
+    close();
+}
+
+bool FileRingBuffer::open(const char *szPath, uint32_t nSize, int eSync, uint32_t nIntervalMs)
+{
+    close();
+
+    if(nSize && !is_power_of_two(nSize))
+        nSize = roundup_pow_of_two(nSize);
+
+    bool bCreated = false;
+    if(!map(szPath, nSize, &bCreated))
+        return false;
+
+    //已有文件的大小和要求的不一致
+    if(nSize && nSize != m_nSize) {
+        unmap();
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    m_eSync = eSync;
+    m_interval = std::chrono::milliseconds(nIntervalMs);
+    m_lastSync = std::chrono::steady_clock::now();
+
+    m_bRecovered = !bCreated && recover();
+    if(!m_bRecovered)
+        format();
+
+    return true;
+}
+
+void FileRingBuffer::close()
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    if(!m_pHeader)
+        return;
+
+    sync_locked();
+    unmap();
+
+    m_cv.notify_all();
+}
+
+bool FileRingBuffer::recover()
+{
+    const FileRingIndex *pBest = NULL;
+
+    for(int i = 0; i < 2; i++) {
+        const FileRingIndex *pIndex = &m_pHeader->aIndex[i];
+
+        if(pIndex->nCheck != index_check(pIndex) || pIndex->nIn - pIndex->nOut > m_nSize)
+            continue;
+
+        if(!pBest || (int32_t)(pIndex->nSeq - pBest->nSeq) > 0)
+            pBest = pIndex;
+    }
+
+    if(!pBest)
+        return false;
+
+    m_nIn = pBest->nIn;
+    m_nOut = pBest->nOut;
+    m_nSeq = pBest->nSeq;
+
+    return true;
+}
+
+void FileRingBuffer::format()
+{
+    m_nIn = m_nOut = m_nSeq = 0;
+
+    memset(m_pHeader->aIndex, 0, sizeof(m_pHeader->aIndex));
+    m_pHeader->aIndex[0].nCheck = index_check(&m_pHeader->aIndex[0]);
+
+    m_pHeader->nVersion = FILERING_VERSION;
+    m_pHeader->nSize = m_nSize;
+    m_pHeader->nDataOffset = FILERING_DATA_OFFSET;
+    m_pHeader->nMagic = FILERING_MAGIC;
+
+    flush(0, sizeof(FileRingHeader));
+}
+
+void FileRingBuffer::flush_data_locked(uint32_t nIdx, uint32_t nLen)
+{
+    RingSpan aSpan[2];
+
+    ring_spans(m_pBuffer, m_nSize, nIdx, nLen, aSpan);
+
+    for(int i = 0; i < 2; i++) {
+        if(aSpan[i].nLen)
+            flush(FILERING_DATA_OFFSET + (size_t)(aSpan[i].pData - m_pBuffer), aSpan[i].nLen);
+    }
+}
+
+void FileRingBuffer::sync_locked()
+{
+    flush(FILERING_DATA_OFFSET, m_nSize);
+    flush(0, sizeof(FileRingHeader));
+
+    m_lastSync = std::chrono::steady_clock::now();
+}
+
+void FileRingBuffer::persist_locked(uint32_t nIdx, uint32_t nLen)
+{
+    //先刷新写入的数据, 再让索引指向它
+    if(m_eSync == FILERING_SYNC_COMMIT && nLen)
+        flush_data_locked(nIdx, nLen);
+
+    //写到另一个槽, 写了一半的槽校验不过, 恢复时会用这一次之前的索引
+    FileRingIndex *pIndex = &m_pHeader->aIndex[++m_nSeq & 1];
+    pIndex->nSeq = m_nSeq;
+    pIndex->nIn = m_nIn;
+    pIndex->nOut = m_nOut;
+    pIndex->nCheck = index_check(pIndex);
+
+    if(m_eSync == FILERING_SYNC_COMMIT)
+        flush(0, sizeof(FileRingHeader));
+    else if(m_eSync == FILERING_SYNC_PERIODIC && std::chrono::steady_clock::now() - m_lastSync >= m_interval)
+        sync_locked();
+}
+
+uint32_t FileRingBuffer::put(const void *pFrom, uint32_t nSize)
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    assert(m_pHeader);
+
+    RingSpan aSpan[2];
+
+    nSize = min(m_nSize - (m_nIn - m_nOut), nSize);
+    if(!nSize)
+        return 0;
+
+    ring_spans(m_pBuffer, m_nSize, m_nIn, nSize, aSpan);
+
+    memcpy(aSpan[0].pData, pFrom, aSpan[0].nLen);
+    memcpy(aSpan[1].pData, (const uint8_t*)pFrom + aSpan[0].nLen, aSpan[1].nLen);
+
+    m_nIn += nSize;
+    persist_locked(m_nIn - nSize, nSize);
+
+    m_cv.notify_all();
+
+    return nSize;
+}
+
+uint32_t FileRingBuffer::get(void *pTo, uint32_t nSize, int nTimeoutMs)
+{
+    std::unique_lock<std::mutex> lk(m_mutex);
+
+    if(m_nIn == m_nOut && nTimeoutMs > 0)
+        m_cv.wait_for(lk, std::chrono::milliseconds(nTimeoutMs), [&] { return m_nIn != m_nOut || !m_pHeader; });
+
+    if(!m_pHeader)
+        return 0;
+
+    RingSpan aSpan[2];
+
+    nSize = min(m_nIn - m_nOut, nSize);
+    if(!nSize)
+        return 0;
+
+    ring_spans(m_pBuffer, m_nSize, m_nOut, nSize, aSpan);
+
+    memcpy(pTo, aSpan[0].pData, aSpan[0].nLen);
+    memcpy((uint8_t*)pTo + aSpan[0].nLen, aSpan[1].pData, aSpan[1].nLen);
+
+    m_nOut += nSize;
+    persist_locked(m_nOut, 0);
+
+    return nSize;
+}
+
+uint32_t FileRingBuffer::peek(RingSpan aSpan[2])
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    assert(m_pHeader);
+
+    return ring_spans(m_pBuffer, m_nSize, m_nOut, m_nIn - m_nOut, aSpan);
+}
+
+void FileRingBuffer::consume(uint32_t nSize)
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    assert(m_pHeader && nSize <= m_nIn - m_nOut);
+
+    m_nOut += nSize;
+    persist_locked(m_nOut, 0);
+}
+
+void FileRingBuffer::sync()
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    if(m_pHeader)
+        sync_locked();
+}
+
+uint32_t FileRingBuffer::length()
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    return m_nIn - m_nOut;
+}
+
+#ifdef _WIN32
+
+bool FileRingBuffer::map(const char *szPath, uint32_t nSize, bool *pCreated)
+{
+    HANDLE hFile = CreateFileA(szPath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(hFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    FileRingHeader header;
+    DWORD dwRead = 0;
+
+    GetFileSizeEx(hFile, &size);
+    memset(&header, 0, sizeof(header));
+    ReadFile(hFile, &header, sizeof(header), &dwRead, NULL);
+
+    //已有的头部有效就按文件里的大小映射, 否则按nSize新建
+    *pCreated = !(dwRead == sizeof(header) && header_valid(&header, (uint64_t)size.QuadPart));
+    if(*pCreated) {
+        if(!nSize) {
+            CloseHandle(hFile);
+            return false;
+        }
+
+        header.nSize = nSize;
+        size.QuadPart = FILERING_DATA_OFFSET + (LONGLONG)nSize;
+        if(!SetFilePointerEx(hFile, size, NULL, FILE_BEGIN) || !SetEndOfFile(hFile)) {
+            CloseHandle(hFile);
+            return false;
+        }
+    }
+
+    size_t nMapSize = FILERING_DATA_OFFSET + (size_t)header.nSize;
+    HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READWRITE, (DWORD)((uint64_t)nMapSize >> 32), (DWORD)nMapSize, NULL);
+    void *p = hMapping ? MapViewOfFile(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, nMapSize) : NULL;
+    if(!p) {
+        if(hMapping)
+            CloseHandle(hMapping);
+        CloseHandle(hFile);
+        return false;
+    }
+
+    m_hFile = hFile;
+    m_hMapping = hMapping;
+    m_pHeader = (FileRingHeader*)p;
+    m_pBuffer = (uint8_t*)p + FILERING_DATA_OFFSET;
+    m_nMapSize = nMapSize;
+    m_nSize = header.nSize;
+
+    return true;
+}
+
+void FileRingBuffer::unmap()
+{
+    UnmapViewOfFile(m_pHeader);
+    CloseHandle((HANDLE)m_hMapping);
+    CloseHandle((HANDLE)m_hFile);
+
+    m_hFile = INVALID_HANDLE_VALUE;
+    m_hMapping = NULL;
+    m_pHeader = NULL;
+    m_pBuffer = NULL;
+}
+
+void FileRingBuffer::flush(size_t nOffset, size_t nLen)
+{
+    //FlushViewOfFile只把脏页交给系统, FlushFileBuffers才等到落盘
+    FlushViewOfFile((uint8_t*)m_pHeader + nOffset, nLen);
+    FlushFileBuffers((HANDLE)m_hFile);
+}
+
+#else
+
+bool FileRingBuffer::map(const char *szPath, uint32_t nSize, bool *pCreated)
+{
+    int fd = ::open(szPath, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+    FileRingHeader header;
+
+    memset(&header, 0, sizeof(header));
+    if(fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    //已有的头部有效就按文件里的大小映射, 否则按nSize新建
+    ssize_t nRead = pread(fd, &header, sizeof(header), 0);
+    *pCreated = !(nRead == (ssize_t)sizeof(header) && header_valid(&header, (uint64_t)st.st_size));
+    if(*pCreated) {
+        header.nSize = nSize;
+        if(!nSize || ftruncate(fd, (off_t)FILERING_DATA_OFFSET + nSize) != 0) {
+            ::close(fd);
+            return false;
+        }
+    }
+
+    size_t nMapSize = FILERING_DATA_OFFSET + (size_t)header.nSize;
+    void *p = mmap(NULL, nMapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(p == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+
+    m_fd = fd;
+    m_pHeader = (FileRingHeader*)p;
+    m_pBuffer = (uint8_t*)p + FILERING_DATA_OFFSET;
+    m_nMapSize = nMapSize;
+    m_nSize = header.nSize;
+
+    return true;
+}
+
+void FileRingBuffer::unmap()
+{
+    munmap(m_pHeader, m_nMapSize);
+    ::close(m_fd);
+
+    m_fd = -1;
+    m_pHeader = NULL;
+    m_pBuffer = NULL;
+}
+
+void FileRingBuffer::flush(size_t nOffset, size_t nLen)
+{
+    //msync要求地址按页对齐
+    size_t nPage = (size_t)sysconf(_SC_PAGESIZE);
+    size_t nBegin = nOffset / nPage * nPage;
+
+    msync((uint8_t*)m_pHeader + nBegin, nOffset + nLen - nBegin, MS_SYNC);
+}
+
+#endif // _WIN32
@@ -0,0 +1,120 @@
+#ifndef FILERINGBUFFER_H
+#define FILERINGBUFFER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "ringutil.h"
+
+#define FILERING_MAGIC   0x474E5246U //"FRNG"
+#define FILERING_VERSION 1
+
+//数据区在文件中的偏移, 对齐到页(Windows下也是分配粒度的约数)
+#define FILERING_DATA_OFFSET 4096
+
+//索引什么时候刷到磁盘
+enum FileRingSync
+{
+    FILERING_SYNC_NONE     = 0, //不主动刷, 交给系统回写; 进程崩溃不丢数据, 断电可能丢
+    FILERING_SYNC_COMMIT   = 1, //每次put/get/consume都先刷数据再刷索引, 断电也不会丢已经返回的写入
+    FILERING_SYNC_PERIODIC = 2, //距离上次刷盘超过nIntervalMs时在下一次读写中刷
+};
+
+//索引槽: 两个槽轮流写, nCheck校验失败(写了一半)时用另一个槽
+struct FileRingIndex
+{
+    uint32_t nSeq;
+    uint32_t nIn;
+    uint32_t nOut;
+    uint32_t nCheck;
+};
+
+//文件开头的头部
+struct FileRingHeader
+{
+    uint32_t nMagic;
+    uint32_t nVersion;
+    uint32_t nSize;
+    uint32_t nDataOffset;
+
+    FileRingIndex aIndex[2];
+};
+
+//用内存映射文件做存储的环形缓冲区, 读写索引保存在文件头部
+//进程崩溃或者重启后重新open, 还没consume的数据可以继续读出(重放)
+//put写入能放下的部分, get/peek+consume读出; 多线程访问由内部的锁保护
+class FileRingBuffer
+{
+public:
+    FileRingBuffer();
+    ~FileRingBuffer();
+
+    FileRingBuffer(const FileRingBuffer&) = delete;
+    FileRingBuffer& operator=(const FileRingBuffer&) = delete;
+
+    //打开szPath, 不存在或者头部无效时按nSize(2的次方)新建; nSize为0表示只打开已有的
+    //eSync为FileRingSync, nIntervalMs只对FILERING_SYNC_PERIODIC有效
+    bool open(const char *szPath, uint32_t nSize, int eSync = FILERING_SYNC_NONE, uint32_t nIntervalMs = 1000);
+    //刷盘并关闭, 不删除文件
+    void close();
+
+    //open时是否从文件中恢复了原有的索引(false表示新建或者原来的头部已损坏)
+    bool recovered() { return m_bRecovered; }
+
+    //写入min(剩余空间, nSize)字节, 不阻塞
+    uint32_t put(const void *pFrom, uint32_t nSize);
+    //读出已有的数据, nTimeoutMs > 0时为空会等待, 返回读出的字节数
+    uint32_t get(void *pTo, uint32_t nSize, int nTimeoutMs = 0);
+
+    //至少一次语义: peek取出数据处理完之后再consume, 处理中崩溃的数据重启后会再读到
+    uint32_t peek(RingSpan aSpan[2]);
+    void consume(uint32_t nSize);
+
+    //立即把数据和索引刷到磁盘
+    void sync();
+
+    uint32_t length();
+    uint32_t size() { return m_nSize; }
+
+private:
+    bool map(const char *szPath, uint32_t nSize, bool *pCreated);
+    void unmap();
+    void flush(size_t nOffset, size_t nLen);
+    bool recover();
+    void format();
+    void persist_locked(uint32_t nIdx, uint32_t nLen);
+    void sync_locked();
+    void flush_data_locked(uint32_t nIdx, uint32_t nLen);
+
+private:
+    FileRingHeader *m_pHeader = NULL;
+    uint8_t  *m_pBuffer = NULL;
+    size_t   m_nMapSize;
+    uint32_t m_nSize;
+    bool     m_bRecovered;
+
+#ifdef _WIN32
+    void     *m_hFile;
+    void     *m_hMapping;
+#else
+    int      m_fd;
+#endif
+
+    //内存中的索引, 每次变化后写进头部的下一个槽
+    uint32_t m_nIn;
+    uint32_t m_nOut;
+    uint32_t m_nSeq;
+
+    int      m_eSync;
+    std::chrono::milliseconds m_interval;
+    std::chrono::steady_clock::time_point m_lastSync;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+};
+
+#endif // FILERINGBUFFER_H
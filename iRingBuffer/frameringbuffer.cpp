@@ -0,0 +1,178 @@
+/*
+ * =====================================================================================
+ *       Filename:  frameringbuffer.cpp
+ *
+ *    Description:  按记录存取的环形缓冲区
+ *         Others:  1.记录格式: uint32_t长度头 + 数据, 整体按8字节对齐, 所以缓冲区末尾至少能放下一个长度头.
+ *                  2.记录到缓冲区末尾放不下时, 在当前位置写一个FRAME_PAD头, 跳到缓冲区开头再写,
+ *                    保证每条记录在内存中都是连续的, 读出时可以直接把指针交给调用者.
+ *                  3.镜像映射的存储不需要填充.
+ *                  4.缓冲区为空时把in/out对齐到下一圈的开头, 这样空缓冲区总能放下max_record()大小的记录.
+ *                  5.pop出去的记录在release之前m_nOut不动(m_nPending记录它的长度), 所以同时只能有一条,
+ *                    这期间pop/try_pop返回false, clear保留这一条.
+ * =====================================================================================
+ */
+
+#include "frameringbuffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//记录对齐
+#define FRAME_ALIGN(n)  (((n) + 7) & ~7U)
+//填充标志, 读到它说明本圈剩下的部分都是空的
+#define FRAME_PAD       0xFFFFFFFFU
+
+FrameRingBuffer::FrameRingBuffer(uint32_t nSize, uint32_t nFlags)
+{
+    if(nSize < 16)
+        nSize = 16;
+
+    if(!is_power_of_two(nSize))
+        nSize = roundup_pow_of_two(nSize);
+
+    ring_alloc(&m_memory, nSize, nFlags);
+    m_pBuffer = m_memory.pBuffer;
+
+    assert(m_pBuffer);
+
+    m_nSize = m_memory.nSize;
+    m_bMirrored = (m_memory.nFlags & RING_ALLOC_MIRRORED) != 0;
+    m_nIn = m_nOut = 0;
+    m_nRecords = m_nPending = 0;
+}
+
+FrameRingBuffer::~FrameRingBuffer()
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    if(m_pBuffer) {
+        ring_free(&m_memory);
+        m_pBuffer = NULL;
+    }
+    m_cv.notify_all();
+}
+
+bool FrameRingBuffer::try_push_record(const void *pFrom, uint32_t nSize)
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    if(nSize > max_record())
+        return false;
+
+    uint32_t nNeed = FRAME_ALIGN(sizeof(uint32_t) + nSize);
+
+    //空缓冲区从下一圈开头写, 整个缓冲区都是连续的
+    if(m_nIn == m_nOut && !m_nPending)
+        m_nIn = m_nOut = (m_nIn + m_nSize - 1) & ~(m_nSize - 1);
+
+    uint32_t nFree = m_nSize - (m_nIn - m_nOut);
+    uint32_t nOff  = m_nIn & (m_nSize - 1);
+    uint32_t nPad  = (!m_bMirrored && m_nSize - nOff < nNeed) ? m_nSize - nOff : 0;
+
+    if(nPad + nNeed > nFree)
+        return false;
+
+    if(nPad) {
+        uint32_t nMark = FRAME_PAD;
+        memcpy(m_pBuffer + nOff, &nMark, sizeof(nMark));
+        m_nIn += nPad;
+        nOff = 0;
+    }
+
+    memcpy(m_pBuffer + nOff, &nSize, sizeof(nSize));
+    memcpy(m_pBuffer + nOff + sizeof(nSize), pFrom, nSize);
+
+    m_nIn += nNeed;
+    m_nRecords++;
+
+    m_cv.notify_one();
+
+    return true;
+}
+
+bool FrameRingBuffer::front_record(RingSpan &view)
+{
+    //上一条还没release, m_nOut还指着它
+    if(m_nPending || m_nIn == m_nOut)
+        return false;
+
+    uint32_t nOff = m_nOut & (m_nSize - 1);
+    uint32_t nLen;
+
+    memcpy(&nLen, m_pBuffer + nOff, sizeof(nLen));
+    if(nLen == FRAME_PAD) {
+        m_nOut += m_nSize - nOff;
+        nOff = 0;
+        memcpy(&nLen, m_pBuffer, sizeof(nLen));
+    }
+
+    view.pData = m_pBuffer + nOff + sizeof(nLen);
+    view.nLen  = nLen;
+
+    m_nPending = FRAME_ALIGN(sizeof(nLen) + nLen);
+
+    return true;
+}
+
+bool FrameRingBuffer::pop_record(RingSpan &view)
+{
+    std::unique_lock<std::mutex> lk(m_mutex);
+
+    //有记录没release时等下去也拿不到(单消费者), 直接失败
+    m_cv.wait(lk, [&] { return m_nPending || m_nIn != m_nOut; });
+
+    return front_record(view);
+}
+
+bool FrameRingBuffer::try_pop_record(RingSpan &view)
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    return front_record(view);
+}
+
+void FrameRingBuffer::release_record()
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    if(!m_nPending)
+        return;
+
+    m_nOut += m_nPending;
+    m_nPending = 0;
+    m_nRecords--;
+}
+
+uint32_t FrameRingBuffer::max_record()
+{
+    return m_nSize - FRAME_ALIGN(sizeof(uint32_t));
+}
+
+uint32_t FrameRingBuffer::records()
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    return m_nRecords;
+}
+
+uint32_t FrameRingBuffer::length()
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    return m_nIn - m_nOut;
+}
+
+void FrameRingBuffer::clear()
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    //pop出去的记录还在被读, 只丢掉它后面的
+    if(m_nPending) {
+        m_nIn = m_nOut + m_nPending;
+        m_nRecords = 1;
+        return;
+    }
+
+    m_nIn = m_nOut = 0;
+    m_nRecords = 0;
+}
@@ -0,0 +1,62 @@
+#ifndef FRAMERINGBUFFER_H
+#define FRAMERINGBUFFER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+#include <mutex>
+#include <condition_variable>
+
+#include "ringutil.h"
+#include "ringmemory.h"
+
+//按记录(帧)存取的环形缓冲区
+//每条记录带长度头整条写入, 读出时总是整条, 记录在缓冲区中总是连续的(到末尾放不下时填充跳过)
+//写入可以多线程; 读出只支持单个消费者: 同一时间最多有一条pop出去还没release的记录,
+//release之前再pop(不管哪个线程)都直接返回false, 不会阻塞也不会返回同一条记录
+class FrameRingBuffer
+{
+public:
+    FrameRingBuffer(uint32_t nSize, uint32_t nFlags = RING_ALLOC_HEAP);
+    ~FrameRingBuffer();
+
+    //写入一条记录, 空间不够时返回false, 不会写入半条
+    bool try_push_record(const void *pFrom, uint32_t nSize);
+
+    //取出最早的一条记录, 没有记录时阻塞; view直接指向缓冲区, 用完后调用release_record
+    //上一条记录还没release时立即返回false
+    bool pop_record(RingSpan &view);
+    //同pop_record, 没有记录时立即返回false
+    bool try_pop_record(RingSpan &view);
+    //释放pop出来的记录, 没有pop出来的记录时什么都不做
+    void release_record();
+
+    //单条记录的最大长度
+    uint32_t max_record();
+
+    uint32_t records();
+    uint32_t length();
+
+    //清空记录; 有pop出去还没release的记录时保留这一条, view在release之前一直有效
+    void clear();
+
+private:
+    bool front_record(RingSpan &view);
+
+private:
+    uint8_t  *m_pBuffer = NULL;
+
+    uint32_t m_nSize;
+    bool     m_bMirrored;
+    RingMemory m_memory;
+    uint32_t m_nIn;
+    uint32_t m_nOut;
+
+    uint32_t m_nRecords;
+    uint32_t m_nPending;    //已经pop出去还没release的记录占用的字节数
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+};
+
+#endif // FRAMERINGBUFFER_H
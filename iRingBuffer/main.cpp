@@ -1,4 +1,6 @@
 #include "ringbuffer.h"
+#include "ringbench.h"
+#include "ringtest.h"
 
 #include <iostream>
 #include <future>
@@ -6,6 +8,7 @@
 #include <chrono>
 #include <string>
 #include <random>
+#include <cstring>
 
 #include "ThreadPool.h"
 
@@ -107,9 +110,7 @@ void poolExample() {
 	pool.init();
 
 	for (int i = 1; i < 3; ++i) {
-		for (int j = 1; j < 10; ++j) {
-			pool.submit(multiply, i, j);
-		}
+		pool.submit_bulk([i](size_t j) { multiply(i, (int)j + 1); }, 9);
 	}
 
 	int output_ref;
@@ -147,6 +148,14 @@ struct test4 {
 
 int main(int argc, char* argv[])
 {
+	//iRingBuffer bench [MB]
+	if (argc > 1 && strcmp(argv[1], "bench") == 0)
+		return ringBenchmark(argc - 1, argv + 1);
+
+	//iRingBuffer test [case]
+	if (argc > 1 && strcmp(argv[1], "test") == 0)
+		return ringTest(argc - 1, argv + 1);
+
 	//func_future();
 	//func_decltype();
 
@@ -0,0 +1,240 @@
+/*
+ * =====================================================================================
+ *       Filename:  ringbench.cpp
+ *
+ *    Description:  环形缓冲区性能测试
+ *         Others:  1.每个块的前8字节写入生产者发送时的steady_clock时间, 消费者收到整块后计算交接延迟.
+ *                  2.块必须整块进出, 多生产者/多消费者时才能保持块边界:
+ *                    RingBuffer用RING_PUT_FAIL整块写, get(nMinFill = 块大小)整块读.
+ *                  3.总块数平均分给消费者, 每个消费者读够自己的份额就退出, 不需要超时.
+ * =====================================================================================
+ */
+
+#include "ringbench.h"
+#include "ringbuffer.h"
+#include "spscringbuffer.h"
+#include "frameringbuffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock BenchClock;
+
+static uint64_t bench_now()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now().time_since_epoch()).count();
+}
+
+//各实现统一成整块push/pop
+class MutexBench
+{
+public:
+    MutexBench(uint32_t nSize, uint32_t nFlags) : m_ring(nSize, nFlags) {}
+
+    bool push(uint8_t *pData, uint32_t nLen) { return m_ring.put(pData, nLen, RING_PUT_FAIL) == nLen; }
+    void pop(uint8_t *pData, uint32_t nLen) { m_ring.get(pData, nLen, nLen); }
+
+private:
+    RingBuffer m_ring;
+};
+
+class SpscBench
+{
+public:
+    SpscBench(uint32_t nSize, uint32_t nFlags) : m_ring(nSize, nFlags) {}
+
+    bool push(uint8_t *pData, uint32_t nLen)
+    {
+        //单生产者, 写了一部分就一定能写完, 不会和别的块交错
+        uint32_t nDone = m_ring.put(pData, nLen);
+        if(!nDone)
+            return false;
+        while(nDone < nLen) {
+            uint32_t n = m_ring.put(pData + nDone, nLen - nDone);
+            if(!n)
+                std::this_thread::yield();
+            nDone += n;
+        }
+        return true;
+    }
+
+    void pop(uint8_t *pData, uint32_t nLen)
+    {
+        uint32_t nDone = 0;
+        while(nDone < nLen) {
+            uint32_t n = m_ring.get(pData + nDone, nLen - nDone);
+            if(!n)
+                std::this_thread::yield();
+            nDone += n;
+        }
+    }
+
+private:
+    SpscRingBuffer m_ring;
+};
+
+class FrameBench
+{
+public:
+    FrameBench(uint32_t nSize, uint32_t nFlags) : m_ring(nSize, nFlags) {}
+
+    bool push(uint8_t *pData, uint32_t nLen) { return m_ring.try_push_record(pData, nLen); }
+
+    void pop(uint8_t *pData, uint32_t nLen)
+    {
+        //记录是零拷贝读出的, 只取时间戳
+        RingSpan view;
+        m_ring.pop_record(view);
+        memcpy(pData, view.pData, sizeof(uint64_t));
+        m_ring.release_record();
+        (void)nLen;
+    }
+
+private:
+    FrameRingBuffer m_ring;
+};
+
+struct BenchResult
+{
+    double dSeconds;
+    uint64_t nChunks;
+    std::vector<uint64_t> latency;
+};
+
+template <typename Ring>
+static BenchResult bench_run(uint32_t nRing, uint32_t nFlags, uint32_t nChunk, int nProducers, int nConsumers, uint64_t nTotal)
+{
+    Ring ring(nRing, nFlags);
+
+    uint64_t nPerProducer = nTotal / nChunk / nProducers;
+    uint64_t nChunks = nPerProducer * nProducers;
+
+    std::vector<std::vector<uint64_t>> latency(nConsumers);
+    std::vector<std::thread> threads;
+    std::atomic<int> nReady(0);
+    std::atomic<bool> bGo(false);
+
+    for(int c = 0; c < nConsumers; c++) {
+        uint64_t nQuota = nChunks / nConsumers + (c < (int)(nChunks % nConsumers) ? 1 : 0);
+        threads.emplace_back([&, c, nQuota] {
+            std::vector<uint8_t> buf(nChunk);
+            std::vector<uint64_t> &lat = latency[c];
+            lat.reserve((size_t)nQuota);
+            nReady++;
+            while(!bGo) std::this_thread::yield();
+
+            for(uint64_t i = 0; i < nQuota; i++) {
+                uint64_t nStamp;
+                ring.pop(buf.data(), nChunk);
+                memcpy(&nStamp, buf.data(), sizeof(nStamp));
+                lat.push_back(bench_now() - nStamp);
+            }
+        });
+    }
+
+    for(int p = 0; p < nProducers; p++) {
+        threads.emplace_back([&] {
+            std::vector<uint8_t> buf(nChunk, 0x5A);
+            nReady++;
+            while(!bGo) std::this_thread::yield();
+
+            for(uint64_t i = 0; i < nPerProducer; i++) {
+                for(;;) {
+                    uint64_t nStamp = bench_now();
+                    memcpy(buf.data(), &nStamp, sizeof(nStamp));
+                    if(ring.push(buf.data(), nChunk))
+                        break;
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    while(nReady < nProducers + nConsumers) std::this_thread::yield();
+
+    BenchClock::time_point start = BenchClock::now();
+    bGo = true;
+    for(auto &t : threads)
+        t.join();
+    BenchClock::time_point end = BenchClock::now();
+
+    BenchResult result;
+    result.dSeconds = std::chrono::duration<double>(end - start).count();
+    result.nChunks = nChunks;
+    for(auto &lat : latency)
+        result.latency.insert(result.latency.end(), lat.begin(), lat.end());
+    std::sort(result.latency.begin(), result.latency.end());
+
+    return result;
+}
+
+static double percentile_us(const std::vector<uint64_t> &sorted, double dQuantile)
+{
+    if(sorted.empty())
+        return 0;
+
+    size_t nIndex = (size_t)(dQuantile * (sorted.size() - 1));
+    return sorted[nIndex] / 1000.0;
+}
+
+static void bench_print(const char *szMode, uint32_t nRing, uint32_t nChunk, int nProducers, int nConsumers, const BenchResult &r)
+{
+    double dBytes = (double)r.nChunks * nChunk;
+
+    printf("%-16s %9u %7u %3dx%-3d %10.1f %9.3f %10.2f %10.2f %10.2f\n",
+           szMode, nRing, nChunk, nProducers, nConsumers,
+           dBytes / r.dSeconds / (1024 * 1024), r.nChunks / r.dSeconds / 1e6,
+           percentile_us(r.latency, 0.50), percentile_us(r.latency, 0.99), percentile_us(r.latency, 0.999));
+    fflush(stdout);
+}
+
+int ringBenchmark(int argc, char* argv[])
+{
+    uint64_t nTotalMB = argc > 1 ? strtoull(argv[1], NULL, 10) : 64;
+    if(!nTotalMB)
+        nTotalMB = 64;
+
+    const uint64_t nTotal = nTotalMB << 20;
+    const uint32_t aRing[]  = { 4 << 10, 64 << 10, 1 << 20 };
+    const uint32_t aChunk[] = { 16, 256, 4096 };
+    const int aPair[][2] = { { 1, 1 }, { 2, 1 }, { 1, 2 }, { 2, 2 } };
+
+    printf("%-16s %9s %7s %7s %10s %9s %10s %10s %10s\n",
+           "mode", "ring", "chunk", "PxC", "MB/s", "Mops/s", "p50(us)", "p99(us)", "p999(us)");
+
+    for(uint32_t nRing : aRing) {
+        for(uint32_t nChunk : aChunk) {
+            //块比缓冲区的一半还大时整块写入很难成功, 没有参考意义
+            if(nChunk > nRing / 2)
+                continue;
+
+            for(auto &pair : aPair) {
+                BenchResult r = bench_run<MutexBench>(nRing, RING_ALLOC_HEAP, nChunk, pair[0], pair[1], nTotal);
+                bench_print("mutex", nRing, nChunk, pair[0], pair[1], r);
+            }
+
+            BenchResult r = bench_run<MutexBench>(nRing, RING_ALLOC_MIRRORED, nChunk, 1, 1, nTotal);
+            bench_print("mutex-mirrored", nRing, nChunk, 1, 1, r);
+
+            r = bench_run<SpscBench>(nRing, RING_ALLOC_HEAP, nChunk, 1, 1, nTotal);
+            bench_print("spsc", nRing, nChunk, 1, 1, r);
+
+            r = bench_run<SpscBench>(nRing, RING_ALLOC_MIRRORED, nChunk, 1, 1, nTotal);
+            bench_print("spsc-mirrored", nRing, nChunk, 1, 1, r);
+
+            r = bench_run<FrameBench>(nRing, RING_ALLOC_HEAP, nChunk, 1, 1, nTotal);
+            bench_print("frame", nRing, nChunk, 1, 1, r);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
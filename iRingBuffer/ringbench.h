@@ -0,0 +1,8 @@
+#ifndef RINGBENCH_H
+#define RINGBENCH_H
+
+//环形缓冲区性能测试: iRingBuffer bench [每组总数据量MB]
+//遍历实现 x 缓冲区大小 x 块大小 x 生产者/消费者个数, 输出吞吐量和交接延迟的p50/p99/p999
+int ringBenchmark(int argc, char* argv[]);
+
+#endif // RINGBENCH_H
@@ -9,6 +9,8 @@
  *                  3.分为2部进行copy，一为当前偏移到size-1 二为剩余部分0到(len减去一中的个数)
  *                  4.unsiged int下的(in - out)始终为in和out之间的距离，(in溢出后in:0x1 - out:0xffffffff = 2任然满足)(缓冲区中未脏的数据).
  *                  5.计算偏移(in) & (size - 1) <==> in%size
+ *                  6.镜像映射的存储(RING_ALLOC_MIRRORED)下缓冲区后面紧跟着它自己, 不用拆分, 一次copy完成.
+ *                  7.resize时字节按绝对索引i搬到新存储的(i & (新size - 1))处, in/out不需要改.
  *        Version:  1.0
  *        Date:     Wednesday, March 20, 2019 10:00:00 CST
  *       Revision:  none
@@ -21,123 +23,582 @@
  */
 
 #include "ringbuffer.h"
+#include "ringutil.h"
+
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
 
-//判断x是否是2的次方
-#define is_power_of_two(x) ((x) != 0 && (((x) & ((x) - 1)) == 0))
 //取a和b中最小值
 #define min(a, b) (((a) < (b)) ? (a) : (b))
-//取比n大最小2的次方值
-#define roundup_pow_of_two(n)      \
-    (1UL    <<                     \
-    (                              \
-    (                              \
-    (n) & (1UL << 31) ? 31 :       \
-    (n) & (1UL << 30) ? 30 :       \
-    (n) & (1UL << 29) ? 29 :       \
-    (n) & (1UL << 28) ? 28 :       \
-    (n) & (1UL << 27) ? 27 :       \
-    (n) & (1UL << 26) ? 26 :       \
-    (n) & (1UL << 25) ? 25 :       \
-    (n) & (1UL << 24) ? 24 :       \
-    (n) & (1UL << 23) ? 23 :       \
-    (n) & (1UL << 22) ? 22 :       \
-    (n) & (1UL << 21) ? 21 :       \
-    (n) & (1UL << 20) ? 20 :       \
-    (n) & (1UL << 19) ? 19 :       \
-    (n) & (1UL << 18) ? 18 :       \
-    (n) & (1UL << 17) ? 17 :       \
-    (n) & (1UL << 16) ? 16 :       \
-    (n) & (1UL << 15) ? 15 :       \
-    (n) & (1UL << 14) ? 14 :       \
-    (n) & (1UL << 13) ? 13 :       \
-    (n) & (1UL << 12) ? 12 :       \
-    (n) & (1UL << 11) ? 11 :       \
-    (n) & (1UL << 10) ? 10 :       \
-    (n) & (1UL <<  9) ?  9 :       \
-    (n) & (1UL <<  8) ?  8 :       \
-    (n) & (1UL <<  7) ?  7 :       \
-    (n) & (1UL <<  6) ?  6 :       \
-    (n) & (1UL <<  5) ?  5 :       \
-    (n) & (1UL <<  4) ?  4 :       \
-    (n) & (1UL <<  3) ?  3 :       \
-    (n) & (1UL <<  2) ?  2 :       \
-    (n) & (1UL <<  1) ?  1 :       \
-    (n) & (1UL <<  0) ?  0 : -1    \
-    ) + 1                          \
-    )                              \
-    )
-
-RingBuffer::RingBuffer(uint32_t nSize)
+
+//把绝对索引[nIdx, nIdx + nLen)的数据从一个环形缓冲区搬到另一个大小不同的环形缓冲区
+static void ring_migrate(const uint8_t *pFrom, uint32_t nFromSize, uint8_t *pTo, uint32_t nToSize, uint32_t nIdx, uint32_t nLen)
+{
+    while(nLen) {
+        uint32_t nFromOff = nIdx & (nFromSize - 1);
+        uint32_t nToOff   = nIdx & (nToSize - 1);
+        uint32_t n = min(nLen, min(nFromSize - nFromOff, nToSize - nToOff));
+
+        memcpy(pTo + nToOff, pFrom + nFromOff, n);
+
+        nIdx += n;
+        nLen -= n;
+    }
+}
+
+RingBuffer::RingBuffer(uint32_t nSize, uint32_t nFlags)
 {
     if(!is_power_of_two(nSize))
         nSize = roundup_pow_of_two(nSize);
 
-    m_pBuffer = (uint8_t*)malloc(nSize);
+    ring_alloc(&m_memory, nSize, nFlags);
+    m_pBuffer = m_memory.pBuffer;
+    m_nAllocFlags = nFlags;
 
     assert(m_pBuffer);
 
-    m_nSize = nSize;
+    m_nSize = m_memory.nSize;
+    m_bMirrored = (m_memory.nFlags & RING_ALLOC_MIRRORED) != 0;
     m_nIn = m_nOut = 0;
+
+    m_eNotify = RING_NOTIFY_WAITER;
+    m_nWatermark = 0;
+    m_nWaiters = 0;
+    m_nWaitFill = UINT32_MAX;
+    m_bFlush = false;
+
+    m_nPutWaiters = 0;
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_nResets = 0;
+
+    ring_event_init(&m_evReadable);
+    ring_event_init(&m_evWritable);
+    m_nReadThreshold = m_nWriteThreshold = 1;
 }
 
 RingBuffer::~RingBuffer()
 {
     std::lock_guard<std::mutex> lk(m_mutex);
     if(m_pBuffer) {
-        free(m_pBuffer);
+        ring_free(&m_memory);
         m_pBuffer = NULL;
     }
     m_cv.notify_all();
+    m_cvPut.notify_all();
+
+    ring_event_close(&m_evReadable);
+    ring_event_close(&m_evWritable);
 }
 
 uint32_t RingBuffer::put(void *pFrom, uint32_t nSize)
 {
-    std::lock_guard<std::mutex> lk(m_mutex);
+    return put(pFrom, nSize, RING_PUT_TRUNCATE);
+}
+
+uint32_t RingBuffer::put(void *pFrom, uint32_t nSize, int ePut)
+{
+    RingSpan seg = { (uint8_t*)pFrom, nSize };
+
+    //单段的阻塞写像管道一样分批写入, 不要求一次放下
+    if(ePut == RING_PUT_BLOCK) {
+        std::unique_lock<std::mutex> lk(m_mutex);
+
+        return put_wait_locked(lk, &seg, 1, nSize, NULL);
+    }
+
+    return putv(&seg, 1, ePut);
+}
+
+uint32_t RingBuffer::put(void *pFrom, uint32_t nSize, const std::chrono::steady_clock::time_point &deadline)
+{
+    std::unique_lock<std::mutex> lk(m_mutex);
+
+    RingSpan seg = { (uint8_t*)pFrom, nSize };
+
+    return put_wait_locked(lk, &seg, 1, nSize, &deadline);
+}
+
+uint32_t RingBuffer::putv(const RingSpan *aSeg, int nCount, int ePut)
+{
+    uint32_t nSize = 0, nSkip = 0;
+    for(int i = 0; i < nCount; i++)
+        nSize += aSeg[i].nLen;
+
+    std::unique_lock<std::mutex> lk(m_mutex);
+
+    uint32_t nFree = m_nSize - (m_nIn - m_nOut);
+
+    switch(ePut) {
+    case RING_PUT_BLOCK:
+        return putv_wait_locked(lk, aSeg, nCount, nSize);
+
+    case RING_PUT_FAIL:
+        if(nSize > nFree) {
+            drop_locked(nSize);
+            return 0;
+        }
+        break;
+
+    case RING_PUT_OVERWRITE:
+        //比整个缓冲区还大时只保留最后m_nSize字节
+        if(nSize > m_nSize) {
+            m_stats.nOverwritten += nSize - m_nSize;
+            nSkip = nSize - m_nSize;
+            nSize = m_nSize;
+        }
+        if(nSize > nFree) {
+            m_stats.nOverwritten += nSize - nFree;
+            m_nOut += nSize - nFree;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    uint32_t nLen = write_locked(aSeg, nCount, nSkip, nSize);
+
+    drop_locked(nSize - nLen);
+
+    notify_locked();
+
+    return nLen;
+}
+
+uint32_t RingBuffer::put_wait_locked(std::unique_lock<std::mutex> &lk, const RingSpan *aSeg, int nCount, uint32_t nSize, const std::chrono::steady_clock::time_point *pDeadline)
+{
+    uint32_t nDone = 0;
+
+    //像管道一样有多少空间写多少, 写满了才等; 等待时缓冲区一定是满的, 消费者不会因为nMinFill不够而和生产者互相等
+    while(nDone < nSize) {
+        uint32_t nLen = write_locked(aSeg, nCount, nDone, nSize - nDone);
+        nDone += nLen;
+
+        if(nLen)
+            notify_locked();
+
+        if(nDone == nSize || !m_pBuffer)
+            break;
+
+        auto ready = [&] { return m_nIn - m_nOut < m_nSize || !m_pBuffer; };
+
+        m_nPutWaiters++;
+
+        auto start = std::chrono::steady_clock::now();
+
+        bool bReady = true;
+        if(pDeadline)
+            bReady = m_cvPut.wait_until(lk, *pDeadline, ready);
+        else
+            m_cvPut.wait(lk, ready);
+
+        m_nPutWaiters--;
+
+        m_stats.nPutWaits++;
+        m_stats.nPutWaitUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+        if(!bReady)
+            break;
+    }
+
+    drop_locked(nSize - nDone);
+
+    return nDone;
+}
+
+uint32_t RingBuffer::putv_wait_locked(std::unique_lock<std::mutex> &lk, const RingSpan *aSeg, int nCount, uint32_t nSize)
+{
+    //分批写的话等待时会放开锁, 别的生产者的数据就插到各段中间了, 所以等到空闲空间放得下全部再一次写入;
+    //比缓冲区还大(包括等待中被resize缩小)时永远放不下, 一个字节都不写
+    auto ready = [&] { return m_nSize - (m_nIn - m_nOut) >= nSize || nSize > m_nSize || !m_pBuffer; };
+
+    if(!ready()) {
+        m_nPutWaiters++;
+
+        auto start = std::chrono::steady_clock::now();
+
+        m_cvPut.wait(lk, ready);
+
+        m_nPutWaiters--;
+
+        m_stats.nPutWaits++;
+        m_stats.nPutWaitUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    if(nSize > m_nSize || !m_pBuffer) {
+        drop_locked(nSize);
+        return 0;
+    }
+
+    uint32_t nLen = write_locked(aSeg, nCount, 0, nSize);
+
+    notify_locked();
+
+    return nLen;
+}
 
+void RingBuffer::copy_in(uint32_t nIdx, const uint8_t *pFrom, uint32_t nSize)
+{
     uint32_t nLen, nOff;
 
-    //min(大小 - 已经用了的, nSize) 计算剩余可用空间
-    nSize = min(m_nSize - (m_nIn - m_nOut), nSize);
-    nOff  = (m_nIn + 0) & (m_nSize - 1); // ==> (m_nIn+0)%m_nSize
-    nLen  = min(nSize, m_nSize - nOff);
+    nOff  = (nIdx + 0) & (m_nSize - 1); // ==> (nIdx+0)%m_nSize
+    nLen  = m_bMirrored ? nSize : min(nSize, m_nSize - nOff);
 
     //nSize 的部分 nLen
     memcpy(m_pBuffer + nOff, pFrom, nLen);
 
     //nSize 的剩余部分，如果nSize == nLen则啥也不干
-    memcpy(m_pBuffer, (uint8_t*)pFrom+nLen, nSize-nLen);
+    memcpy(m_pBuffer, pFrom+nLen, nSize-nLen);
+}
 
-    m_nIn += nSize;
+void RingBuffer::copy_out(uint32_t nIdx, uint8_t *pTo, uint32_t nSize)
+{
+    uint32_t nLen, nOff;
+
+    nOff = (nIdx + 0) & (m_nSize - 1); //==> (nIdx + 0)%m_nSize
+    nLen = m_bMirrored ? nSize : min(nSize, m_nSize - nOff);
+
+    //nSize 的部分 nLen
+    memcpy(pTo, m_pBuffer+nOff, nLen);
+
+    //nSize 的剩余部分，如果nSize == nLen则啥也不干
+    memcpy(pTo+nLen, m_pBuffer, nSize-nLen);
+}
+
+uint32_t RingBuffer::write_locked(const RingSpan *aSeg, int nCount, uint32_t nSkip, uint32_t nSize)
+{
+    //min(大小 - 已经用了的, nSize) 计算剩余可用空间
+    nSize = min(m_nSize - (m_nIn - m_nOut), nSize);
 
-    m_cv.notify_one();
+    //跳过各段中已经写过的nSkip字节, 再依次拷贝
+    uint32_t nIdx = m_nIn, nLeft = nSize;
+    for(int i = 0; i < nCount && nLeft; i++) {
+        if(nSkip >= aSeg[i].nLen) {
+            nSkip -= aSeg[i].nLen;
+            continue;
+        }
+
+        uint32_t nLen = min(aSeg[i].nLen - nSkip, nLeft);
+        copy_in(nIdx, aSeg[i].pData + nSkip, nLen);
+
+        nSkip = 0;
+        nIdx += nLen;
+        nLeft -= nLen;
+    }
+
+    //所有段都拷贝完才更新一次索引
+    fill_locked(nSize);
 
     return nSize;
 }
 
+void RingBuffer::fill_locked(uint32_t nSize)
+{
+    m_nIn += nSize;
+
+    m_stats.nBytesIn += nSize;
+    if(m_nIn - m_nOut > m_stats.nPeak)
+        m_stats.nPeak = m_nIn - m_nOut;
+}
+
+void RingBuffer::drop_locked(uint32_t nSize)
+{
+    if(!nSize)
+        return;
+
+    m_stats.nDropped += nSize;
+    m_stats.nShortPuts++;
+}
+
+void RingBuffer::release_locked(uint32_t nSize)
+{
+    m_nOut += nSize;
+    m_stats.nBytesOut += nSize;
+
+    //有生产者因为缓冲区满在等待
+    if(m_nPutWaiters && nSize)
+        m_cvPut.notify_all();
+
+    events_locked();
+}
+
+void RingBuffer::events_locked()
+{
+    if(m_evReadable.fd < 0)
+        return;
+
+    uint32_t nLen = m_nIn - m_nOut;
+
+    //阈值超过缓冲区大小(比如resize缩小以后)时按缓冲区大小算, 否则fd永远不会可读
+    if(nLen >= min(m_nReadThreshold, m_nSize))
+        ring_event_set(&m_evReadable);
+    else
+        ring_event_clear(&m_evReadable);
+
+    if(m_nSize - nLen >= min(m_nWriteThreshold, m_nSize))
+        ring_event_set(&m_evWritable);
+    else
+        ring_event_clear(&m_evWritable);
+}
+
 uint32_t RingBuffer::get(void *pTo, uint32_t nSize)
+{
+    return get(pTo, nSize, 1);
+}
+
+uint32_t RingBuffer::get(void *pTo, uint32_t nSize, uint32_t nMinFill)
 {
     std::unique_lock<std::mutex> lk(m_mutex);
 
-    m_cv.wait(lk, [&] { return m_nIn != m_nOut; });
+    wait_locked(lk, min(nMinFill, nSize), NULL);
 
-    uint32_t nLen, nOff;
+    RingSpan seg = { (uint8_t*)pTo, nSize };
+
+    return read_locked(&seg, 1, nSize);
+}
+
+uint32_t RingBuffer::get(void *pTo, uint32_t nSize, uint32_t nMinFill, const std::chrono::steady_clock::time_point &deadline)
+{
+    std::unique_lock<std::mutex> lk(m_mutex);
+
+    wait_locked(lk, min(nMinFill, nSize), &deadline);
+
+    RingSpan seg = { (uint8_t*)pTo, nSize };
+
+    return read_locked(&seg, 1, nSize);
+}
+
+uint32_t RingBuffer::getv(const RingSpan *aSeg, int nCount, uint32_t nMinFill)
+{
+    uint32_t nSize = 0;
+    for(int i = 0; i < nCount; i++)
+        nSize += aSeg[i].nLen;
+
+    std::unique_lock<std::mutex> lk(m_mutex);
+
+    wait_locked(lk, min(nMinFill, nSize), NULL);
+
+    return read_locked(aSeg, nCount, nSize);
+}
+
+void RingBuffer::setNotify(int eNotify, uint32_t nWatermark)
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    m_eNotify = eNotify;
+    m_nWatermark = min(nWatermark, m_nSize);
+}
+
+void RingBuffer::flush()
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    if(m_nIn == m_nOut)
+        return;
+
+    m_bFlush = true;
+    m_cv.notify_all();
+}
+
+void RingBuffer::notify_locked()
+{
+    events_locked();
+
+    //没有人等就不用notify, 省掉一次系统调用
+    if(!m_nWaiters)
+        return;
+
+    //缓冲区满了总是唤醒, 否则阻塞写的生产者会一直等下去
+    if(m_nIn - m_nOut == m_nSize) {
+        wake_locked();
+        return;
+    }
+
+    if(m_eNotify == RING_NOTIFY_FLUSH)
+        return;
+
+    //m_nWaitFill是等待者要求的原值, 按当前大小截断(等待期间可能resize缩小过)
+    uint32_t nFill = min(m_nWaitFill, m_nSize);
+    if(m_eNotify == RING_NOTIFY_WATERMARK)
+        nFill = m_nWatermark > nFill ? m_nWatermark : nFill;
 
+    //等待中的消费者醒来也只会因为数据不够再睡, 所以不够时不唤醒
+    if(m_nIn - m_nOut >= nFill)
+        wake_locked();
+}
+
+void RingBuffer::wake_locked()
+{
+    //m_nWaitFill是所有等待者里最小的nMinFill, notify_one可能叫醒一个要求更多数据的消费者,
+    //它看数据不够又睡回去, 而真正能读的那个一直没被叫醒; 多于一个等待者时全部唤醒
+    if(m_nWaiters > 1)
+        m_cv.notify_all();
+    else
+        m_cv.notify_one();
+}
+
+bool RingBuffer::wait_locked(std::unique_lock<std::mutex> &lk, uint32_t nMinFill, const std::chrono::steady_clock::time_point *pDeadline)
+{
+    //至少等1个字节, 最多等到缓冲区满; 等待期间resize可能把缓冲区缩小到nMinFill以下, 所以每次判断时按当前大小截断
+    if(!nMinFill)
+        nMinFill = 1;
+
+    auto ready = [&] { return m_nIn - m_nOut >= min(nMinFill, m_nSize) || (m_bFlush && m_nIn != m_nOut); };
+    if(ready())
+        return true;
+
+    m_nWaiters++;
+    m_nWaitFill = min(m_nWaitFill, nMinFill);
+
+    auto start = std::chrono::steady_clock::now();
+
+    bool bReady = true;
+    if(pDeadline)
+        bReady = m_cv.wait_until(lk, *pDeadline, ready);
+    else
+        m_cv.wait(lk, ready);
+
+    m_stats.nGetWaits++;
+    m_stats.nGetWaitUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    if(!--m_nWaiters)
+        m_nWaitFill = UINT32_MAX;
+
+    return bReady;
+}
+
+uint32_t RingBuffer::read_locked(const RingSpan *aSeg, int nCount, uint32_t nSize)
+{
     //验证nSize是否大于缓冲区存的值
     nSize = min(m_nIn - m_nOut, nSize);
-    nOff = (m_nOut + 0) & (m_nSize - 1); //==> (m_nOut + 0)%m_nSize
-    nLen = min(nSize, m_nSize - nOff);
 
-    //nSize 的部分 nLen
-    memcpy(pTo, m_pBuffer+nOff, nLen);
+    uint32_t nIdx = m_nOut, nLeft = nSize;
+    for(int i = 0; i < nCount && nLeft; i++) {
+        uint32_t nLen = min(aSeg[i].nLen, nLeft);
+        copy_out(nIdx, aSeg[i].pData, nLen);
 
-    //nSize 的剩余部分，如果nSize == nLen则啥也不干
-    memcpy((uint8_t*)pTo+nLen, m_pBuffer, nSize-nLen);
+        nIdx += nLen;
+        nLeft -= nLen;
+    }
 
-    m_nOut += nSize;
+    release_locked(nSize);
+
+    //flush过的数据全部读走后恢复按nMinFill等待
+    if(m_nIn == m_nOut)
+        m_bFlush = false;
 
     return nSize;
 }
 
+uint32_t RingBuffer::reserve(uint32_t nSize, RingSpan aSpan[2])
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    //只取出空闲空间的位置, 数据由调用者在锁外直接写入
+    nSize = min(m_nSize - (m_nIn - m_nOut), nSize);
+
+    return ring_spans(m_pBuffer, m_nSize, m_nIn, nSize, aSpan, m_bMirrored);
+}
+
+void RingBuffer::commit(uint32_t nSize)
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    assert(nSize <= m_nSize - (m_nIn - m_nOut));
+
+    fill_locked(nSize);
+
+    notify_locked();
+}
+
+uint32_t RingBuffer::peek(RingSpan aSpan[2])
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    return ring_spans(m_pBuffer, m_nSize, m_nOut, m_nIn - m_nOut, aSpan, m_bMirrored);
+}
+
+void RingBuffer::consume(uint32_t nSize)
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    assert(nSize <= m_nIn - m_nOut);
+
+    release_locked(nSize);
+}
+
+#ifndef _WIN32
+ssize_t RingBuffer::readFrom(int fd, uint32_t nSize)
+{
+    RingSpan aSpan[2];
+    struct iovec aVec[2];
+
+    //缓冲区满不是错误, 和writeTo遇到空缓冲区一样返回0, 轮询socket的调用者不会把它当成I/O错误
+    if(!reserve(nSize, aSpan))
+        return 0;
+
+    aVec[0].iov_base = aSpan[0].pData;
+    aVec[0].iov_len  = aSpan[0].nLen;
+    aVec[1].iov_base = aSpan[1].pData;
+    aVec[1].iov_len  = aSpan[1].nLen;
+
+    ssize_t n = readv(fd, aVec, aSpan[1].nLen ? 2 : 1);
+    if(n > 0)
+        commit((uint32_t)n);
+
+    return n;
+}
+
+ssize_t RingBuffer::writeTo(int fd, uint32_t nSize)
+{
+    RingSpan aSpan[2];
+    struct iovec aVec[2];
+
+    uint32_t nLen = min(peek(aSpan), nSize);
+    if(!nLen)
+        return 0;
+
+    //peek返回全部可读数据, 按nSize截断
+    aSpan[0].nLen = min(aSpan[0].nLen, nLen);
+    aSpan[1].nLen = nLen - aSpan[0].nLen;
+
+    aVec[0].iov_base = aSpan[0].pData;
+    aVec[0].iov_len  = aSpan[0].nLen;
+    aVec[1].iov_base = aSpan[1].pData;
+    aVec[1].iov_len  = aSpan[1].nLen;
+
+    ssize_t n = writev(fd, aVec, aSpan[1].nLen ? 2 : 1);
+    if(n > 0)
+        consume((uint32_t)n);
+
+    return n;
+}
+#endif
+
+bool RingBuffer::enableEvents(uint32_t nReadThreshold, uint32_t nWriteThreshold)
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    if(m_evReadable.fd < 0) {
+        if(!ring_event_open(&m_evReadable) || !ring_event_open(&m_evWritable)) {
+            ring_event_close(&m_evReadable);
+            ring_event_close(&m_evWritable);
+            return false;
+        }
+    }
+
+    //阈值为0时fd一直可读, 没有意义
+    m_nReadThreshold  = nReadThreshold ? nReadThreshold : 1;
+    m_nWriteThreshold = nWriteThreshold ? nWriteThreshold : 1;
+
+    events_locked();
+
+    return true;
+}
+
 uint32_t RingBuffer::length()
 {
     std::lock_guard<std::mutex> lk(m_mutex);
@@ -147,6 +608,34 @@ uint32_t RingBuffer::length()
     return nLen;
 }
 
+uint64_t RingBuffer::dropped()
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    return m_stats.nDropped;
+}
+
+uint64_t RingBuffer::overwritten()
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    return m_stats.nOverwritten;
+}
+
+void RingBuffer::stats(RingStats *pStats, bool bReset)
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    *pStats = m_stats;
+    pStats->nLength = m_nIn - m_nOut;
+    pStats->nSize = m_nSize;
+
+    if(bReset) {
+        memset(&m_stats, 0, sizeof(m_stats));
+        m_stats.nPeak = m_nIn - m_nOut;
+    }
+}
+
 uint32_t RingBuffer::head()
 {
     std::lock_guard<std::mutex> lk(m_mutex);
@@ -169,7 +658,86 @@ void RingBuffer::clear()
 {
     std::lock_guard<std::mutex> lk(m_mutex);
     if(m_pBuffer) {
-        free(m_pBuffer);
+        ring_free(&m_memory);
         m_pBuffer = NULL;
     }
 }
+
+void RingBuffer::reset()
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    m_nIn = m_nOut = 0;
+    m_bFlush = false;
+    m_nResets++;
+
+    if(m_nPutWaiters)
+        m_cvPut.notify_all();
+
+    events_locked();
+}
+
+bool RingBuffer::resize(uint32_t nSize)
+{
+    std::lock_guard<std::mutex> lkResize(m_resizeMutex);
+
+    if(!is_power_of_two(nSize))
+        nSize = roundup_pow_of_two(nSize);
+
+    RingMemory memory;
+    if(!ring_alloc(&memory, nSize, m_nAllocFlags))
+        return false;
+
+    uint32_t nIn, nOut, nOldSize, nResets;
+    uint8_t *pOld;
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        nIn = m_nIn;
+        nOut = m_nOut;
+        nOldSize = m_nSize;
+        nResets = m_nResets;
+        pOld = m_pBuffer;
+    }
+
+    //第一阶段不持有锁: 生产者只会写空闲区, 消费者只读不写, 所以快照中切换时还没被读走的部分在搬运过程中不会变;
+    //已经被读走的部分可能被生产者覆盖, 搬错了也没关系
+    bool bCopied = pOld && nIn - nOut <= memory.nSize;
+    if(bCopied)
+        ring_migrate(pOld, nOldSize, memory.pBuffer, memory.nSize, nOut, nIn - nOut);
+
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    //缩小时放不下现有数据
+    if(!m_pBuffer || m_nIn - m_nOut > memory.nSize) {
+        ring_free(&memory);
+        return false;
+    }
+
+    //第二阶段只搬快照之后新写入的数据; 中间reset过或者消费者已经读过了快照的末尾就全部重搬
+    if(bCopied && nResets == m_nResets && m_nOut - nOut <= nIn - nOut)
+        ring_migrate(m_pBuffer, m_nSize, memory.pBuffer, memory.nSize, nIn, m_nIn - nIn);
+    else
+        ring_migrate(m_pBuffer, m_nSize, memory.pBuffer, memory.nSize, m_nOut, m_nIn - m_nOut);
+
+    ring_free(&m_memory);
+
+    m_memory = memory;
+    m_pBuffer = memory.pBuffer;
+    m_nSize = memory.nSize;
+    m_bMirrored = (memory.nFlags & RING_ALLOC_MIRRORED) != 0;
+    m_nWatermark = min(m_nWatermark, m_nSize);
+
+    //变大后可能有生产者可以继续写了; 缩小后等待中的消费者要求的数据量按新大小算, notify_locked里会截断m_nWaitFill
+    if(m_nPutWaiters)
+        m_cvPut.notify_all();
+    notify_locked();
+
+    return true;
+}
+
+uint32_t RingBuffer::size()
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    return m_nSize;
+}
@@ -2,36 +2,183 @@
 #define RINGBUFFER_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include <errno.h>
 #include <assert.h>
 #include <mutex>
 #include <condition_variable>
+#include <chrono>
+#ifndef _WIN32
+#include <sys/types.h>
+#endif
+
+#include "ringutil.h"
+#include "ringmemory.h"
+#include "ringevent.h"
+
+//生产者写入后唤醒消费者的策略
+enum RingNotify
+{
+    RING_NOTIFY_WAITER    = 0,  //有消费者在等待且数据量满足它的nMinFill时唤醒(默认)
+    RING_NOTIFY_WATERMARK = 1,  //数据量还要达到水位线才唤醒
+    RING_NOTIFY_FLUSH     = 2,  //只在flush时唤醒
+};
+
+//缓冲区空间不够时put的处理方式
+enum RingPut
+{
+    RING_PUT_TRUNCATE  = 0, //写入能放下的部分, 返回实际写入的字节数(默认)
+    RING_PUT_BLOCK     = 1, //阻塞直到全部写入
+    RING_PUT_FAIL      = 2, //放不下就一个字节都不写, 返回0
+    RING_PUT_OVERWRITE = 3, //丢弃最早的数据腾出空间, 不能和peek/consume混用
+};
+
+//统计信息快照, 用来调整缓冲区大小、发现消费者卡住等
+struct RingStats
+{
+    uint64_t nBytesIn;      //写入的字节数
+    uint64_t nBytesOut;     //读出(包括consume)的字节数
+    uint64_t nShortPuts;    //没有全部写入的put次数
+    uint64_t nDropped;      //因为空间不够没有写入的字节数
+    uint64_t nOverwritten;  //RING_PUT_OVERWRITE覆盖掉的字节数
+    uint64_t nGetWaits;     //get真正阻塞的次数和总时间(微秒)
+    uint64_t nGetWaitUs;
+    uint64_t nPutWaits;     //put因为缓冲区满阻塞的次数和总时间(微秒)
+    uint64_t nPutWaitUs;
+    uint32_t nPeak;         //数据量的最大值
+    uint32_t nLength;       //快照时的数据量
+    uint32_t nSize;
+};
 
 class RingBuffer
 {
 public:
-    RingBuffer(uint32_t nSize);
+    //nFlags为RingAllocFlag, RING_ALLOC_MIRRORED时读写区域总是连续的一段
+    RingBuffer(uint32_t nSize, uint32_t nFlags = RING_ALLOC_HEAP);
     ~RingBuffer();
 
     uint32_t put(void *pFrom, uint32_t nSize);
+    //ePut为RingPut, 空间不够时按ePut处理
+    uint32_t put(void *pFrom, uint32_t nSize, int ePut);
+    //阻塞写入, 到deadline时写入能放下的部分后返回
+    uint32_t put(void *pFrom, uint32_t nSize, const std::chrono::steady_clock::time_point &deadline);
     uint32_t get(void *pTo, uint32_t nSize);
 
+    //批量读: 阻塞直到至少有min(nMinFill, nSize)字节或者被flush, 再读出最多nSize字节
+    uint32_t get(void *pTo, uint32_t nSize, uint32_t nMinFill);
+    //同上, 到deadline时不再等待, 有多少读多少(可能为0)
+    uint32_t get(void *pTo, uint32_t nSize, uint32_t nMinFill, const std::chrono::steady_clock::time_point &deadline);
+
+    //聚集写/分散读: 多段数据在一次加锁和一次索引更新中完成, 写入时其他生产者的数据不会插在中间
+    //putv的ePut同put; RING_PUT_BLOCK时等到空闲空间放得下各段总长才一次写入, 总长超过缓冲区大小时返回0并计入dropped,
+    //此时消费者的nMinFill加上总长不能超过缓冲区大小, 否则两边会互相等(可以用flush或者带deadline的get解开)
+    //getv阻塞到至少有min(nMinFill, 各段总长)字节
+    uint32_t putv(const RingSpan *aSeg, int nCount, int ePut = RING_PUT_TRUNCATE);
+    uint32_t getv(const RingSpan *aSeg, int nCount, uint32_t nMinFill = 1);
+
+    //设置唤醒策略, nWatermark只对RING_NOTIFY_WATERMARK有效
+    void setNotify(int eNotify, uint32_t nWatermark = 0);
+    //唤醒所有等待的消费者, 读走已有的数据而不再等nMinFill
+    void flush();
+
+    //零拷贝写: reserve返回最多nSize字节的空闲空间(最多两段), 写好后commit实际写入的字节数
+    //reserve和commit之间不能有其他生产者写入
+    uint32_t reserve(uint32_t nSize, RingSpan aSpan[2]);
+    void commit(uint32_t nSize);
+
+    //零拷贝读: peek返回当前所有可读数据(最多两段), 不阻塞; 用完后consume释放
+    //peek和consume之间不能有其他消费者读出
+    uint32_t peek(RingSpan aSpan[2]);
+    void consume(uint32_t nSize);
+
+#ifndef _WIN32
+    //在fd(文件/socket/管道)和缓冲区之间直接搬数据, 省掉中间缓冲区的一次拷贝
+    //readFrom用readv读进空闲空间(最多两段), writeTo用writev写出可读数据; nSize为本次最多搬动的字节数
+    //系统调用时不持有锁, 和reserve/commit、peek/consume一样同时只能有一个生产者调用readFrom、一个消费者调用writeTo
+    //返回搬动的字节数(可能超过2GB, 所以是ssize_t); 出错返回-1并设置errno
+    //缓冲区满(readFrom)或者空(writeTo)时什么都不做, 返回0且不设置errno; readFrom读到EOF也返回0, 需要区分时先看length()
+    ssize_t readFrom(int fd, uint32_t nSize = UINT32_MAX);
+    ssize_t writeTo(int fd, uint32_t nSize = UINT32_MAX);
+#endif
+
+    //打开fd就绪通知, 可以和socket一起放进epoll/poll等事件循环, 不再需要一个阻塞在get上的线程
+    //readableFd在数据量>=nReadThreshold时可读, writableFd在空闲空间>=nWriteThreshold时可读(两个都是监听可读)
+    //水平触发: 条件不满足后fd自动变回不可读; 就绪后用put(RING_PUT_TRUNCATE)/peek/consume/readFrom/writeTo等不阻塞的接口读写
+    //系统不支持时返回false, 两个fd都是-1
+    bool enableEvents(uint32_t nReadThreshold = 1, uint32_t nWriteThreshold = 1);
+    int readableFd() { return m_evReadable.fd; }
+    int writableFd() { return m_evWritable.fd; }
+
     uint32_t length();
 
+    //因为空间不够没有写入的字节数, 和RING_PUT_OVERWRITE覆盖掉的字节数
+    uint64_t dropped();
+    uint64_t overwritten();
+
+    //取统计信息快照; bReset时取完后计数清零, 峰值从当前数据量重新开始, 用于按周期采样
+    //计数都在已经持有的锁内更新, 只有真正阻塞时才取时间
+    void stats(RingStats *pStats, bool bReset = false);
+
+    //存储是否为镜像映射(可能因为系统不支持而退回到普通堆内存)
+    bool mirrored() { return m_bMirrored; }
+
     uint32_t head();
     uint32_t tail();
 
+    //释放存储, 之后不能再使用; 只想清空数据用reset
     void clear();
+    //清空数据, 保留存储
+    void reset();
+
+    //在线调整大小(2的次方), 已有数据搬到新存储中; 数据放不下时失败
+    //搬运大部分数据时不持有锁, 读写可以继续; 调整期间不能有未commit的reserve或者未consume的peek
+    bool resize(uint32_t nSize);
+    uint32_t size();
+
+private:
+    void notify_locked();
+    void wake_locked();
+    bool wait_locked(std::unique_lock<std::mutex> &lk, uint32_t nMinFill, const std::chrono::steady_clock::time_point *pDeadline);
+    void copy_in(uint32_t nIdx, const uint8_t *pFrom, uint32_t nSize);
+    void copy_out(uint32_t nIdx, uint8_t *pTo, uint32_t nSize);
+    uint32_t read_locked(const RingSpan *aSeg, int nCount, uint32_t nSize);
+    uint32_t write_locked(const RingSpan *aSeg, int nCount, uint32_t nSkip, uint32_t nSize);
+    uint32_t put_wait_locked(std::unique_lock<std::mutex> &lk, const RingSpan *aSeg, int nCount, uint32_t nSize, const std::chrono::steady_clock::time_point *pDeadline);
+    uint32_t putv_wait_locked(std::unique_lock<std::mutex> &lk, const RingSpan *aSeg, int nCount, uint32_t nSize);
+    void fill_locked(uint32_t nSize);
+    void release_locked(uint32_t nSize);
+    void drop_locked(uint32_t nSize);
+    void events_locked();
 
 private:
     uint8_t  *m_pBuffer = NULL;
 
     uint32_t m_nSize;
+    bool     m_bMirrored;
+    RingMemory m_memory;
+    uint32_t m_nAllocFlags; //构造时要求的RingAllocFlag, resize时沿用
+    uint32_t m_nResets;     //reset的次数, resize据此判断快照是否还有效
     uint32_t m_nIn;
     uint32_t m_nOut;
 
+    int      m_eNotify;
+    uint32_t m_nWatermark;
+    uint32_t m_nWaiters;    //阻塞在get上的消费者个数
+    uint32_t m_nWaitFill;   //等待中的消费者要求的最小数据量(没有按缓冲区大小截断)
+    bool     m_bFlush;
+
+    uint32_t m_nPutWaiters; //阻塞在put上的生产者个数
+    RingStats m_stats;
+
+    RingEvent m_evReadable;
+    RingEvent m_evWritable;
+    uint32_t m_nReadThreshold;
+    uint32_t m_nWriteThreshold;
+
     std::mutex m_mutex;
+    std::mutex m_resizeMutex;
     std::condition_variable m_cv;
+    std::condition_variable m_cvPut;
 };
 
 #endif // RINGBUFFER_H
@@ -0,0 +1,99 @@
+/*
+ * =====================================================================================
+ *       Filename:  ringevent.cpp
+ *
+ *    Description:  环形缓冲区的fd就绪通知
+ *         Others:  1.eventfd的计数器非0时可读, 置位写1, 清除时read把计数器清0.
+ *                  2.没有eventfd时用管道, 置位往写端写1个字节, 清除时把读端读空; 两端都是非阻塞的.
+ *                  3.bSet记录当前状态, 调用者在锁内调用, 状态不变时不做系统调用.
+ * =====================================================================================
+ */
+
+#include "ringevent.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#endif
+
+void ring_event_init(RingEvent *pEvent)
+{
+    pEvent->fd = -1;
+    pEvent->fdWrite = -1;
+    pEvent->bSet = false;
+}
+
+bool ring_event_open(RingEvent *pEvent)
+{
+    ring_event_init(pEvent);
+
+#if defined(_WIN32)
+    return false;
+#elif defined(__linux__)
+    pEvent->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    pEvent->fdWrite = pEvent->fd;
+
+    return pEvent->fd >= 0;
+#else
+    int fds[2];
+    if(pipe(fds) != 0)
+        return false;
+
+    for(int i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    pEvent->fd = fds[0];
+    pEvent->fdWrite = fds[1];
+
+    return true;
+#endif
+}
+
+void ring_event_close(RingEvent *pEvent)
+{
+#ifndef _WIN32
+    if(pEvent->fdWrite >= 0 && pEvent->fdWrite != pEvent->fd)
+        close(pEvent->fdWrite);
+    if(pEvent->fd >= 0)
+        close(pEvent->fd);
+#endif
+
+    ring_event_init(pEvent);
+}
+
+void ring_event_set(RingEvent *pEvent)
+{
+    if(pEvent->fd < 0 || pEvent->bSet)
+        return;
+
+#ifndef _WIN32
+#ifdef __linux__
+    uint64_t n = 1;
+#else
+    uint8_t n = 1;
+#endif
+    ssize_t r = write(pEvent->fdWrite, &n, sizeof(n));
+    (void)r;
+#endif
+
+    pEvent->bSet = true;
+}
+
+void ring_event_clear(RingEvent *pEvent)
+{
+    if(pEvent->fd < 0 || !pEvent->bSet)
+        return;
+
+#ifndef _WIN32
+    uint64_t n;
+    while(read(pEvent->fd, &n, sizeof(n)) > 0)
+        ;
+#endif
+
+    pEvent->bSet = false;
+}
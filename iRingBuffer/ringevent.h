@@ -0,0 +1,23 @@
+#ifndef RINGEVENT_H
+#define RINGEVENT_H
+
+#include <stdint.h>
+
+//可以放进select/poll/epoll里的就绪通知: 置位时fd可读, 清除后不可读(水平触发)
+//Linux下用eventfd, 其他POSIX系统用非阻塞管道, Windows下不支持
+struct RingEvent
+{
+    int   fd;       //交给事件循环监听可读的fd, 没有打开时为-1
+    int   fdWrite;  //置位时写入的fd, eventfd时和fd相同
+    bool  bSet;
+};
+
+void ring_event_init(RingEvent *pEvent);
+bool ring_event_open(RingEvent *pEvent);
+void ring_event_close(RingEvent *pEvent);
+
+//只在状态变化时做系统调用, 重复置位/清除不进内核
+void ring_event_set(RingEvent *pEvent);
+void ring_event_clear(RingEvent *pEvent);
+
+#endif // RINGEVENT_H
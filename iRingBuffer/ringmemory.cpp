@@ -0,0 +1,348 @@
+/*
+ * =====================================================================================
+ *       Filename:  ringmemory.cpp
+ *
+ *    Description:  环形缓冲区存储的分配
+ *         Others:  1.镜像映射: 同一块内存映射到相邻的两段虚拟地址[p, p+n)和[p+n, p+2n),
+ *                    p[i]和p[i+n]是同一个字节, 所以从任意偏移开始读写n字节都不需要拆成两段.
+ *                  2.Linux下用memfd + 两次MAP_FIXED的mmap; Windows下用页面文件映射 + MapViewOfFileEx.
+ *                  3.映射要求大小是页(Windows下是64K分配粒度)的整数倍, nSize是2的次方, 取两者最大值即可.
+ *                  4.大页/NUMA绑定时直接向系统申请页(mmap/VirtualAlloc), 绑定节点要在第一次访问之前做,
+ *                    所以顺序是: 分配 -> mbind -> mlock -> 预先写一遍每一页.
+ *                  5.每个选项失败时都退回到普通做法并从nFlags中去掉, 调用者根据nFlags知道实际效果.
+ * =====================================================================================
+ */
+
+#ifndef _WIN32
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#endif
+
+#include "ringmemory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+//2MB大页
+#define RING_HUGEPAGE_SIZE  (2U << 20)
+
+#ifdef __linux__
+//<numaif.h>属于libnuma, 这里只用到mbind系统调用, 直接定义需要的常量
+#define RING_MPOL_BIND      2
+#define RING_MPOL_MF_MOVE   (1 << 1)
+#endif
+
+#ifdef _WIN32
+
+static uint32_t mirror_granularity()
+{
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwAllocationGranularity;
+}
+
+static bool mirror_alloc(RingMemory *pMem, uint32_t nSize)
+{
+    HANDLE hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, nSize, NULL);
+    if(!hMapping)
+        return false;
+
+    //先保留2n的地址空间再释放, 然后把两个视图映射上去; 中间可能被其他线程抢占, 所以重试几次
+    for(int i = 0; i < 8; i++) {
+        uint8_t *p = (uint8_t*)VirtualAlloc(NULL, (SIZE_T)nSize * 2, MEM_RESERVE, PAGE_NOACCESS);
+        if(!p)
+            break;
+        VirtualFree(p, 0, MEM_RELEASE);
+
+        uint8_t *p1 = (uint8_t*)MapViewOfFileEx(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, nSize, p);
+        uint8_t *p2 = p1 ? (uint8_t*)MapViewOfFileEx(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, nSize, p + nSize) : NULL;
+        if(p1 && p2) {
+            pMem->pBuffer  = p1;
+            pMem->hMapping = hMapping;
+            return true;
+        }
+
+        if(p1)
+            UnmapViewOfFile(p1);
+    }
+
+    CloseHandle(hMapping);
+    return false;
+}
+
+static void mirror_free(RingMemory *pMem)
+{
+    UnmapViewOfFile(pMem->pBuffer + pMem->nSize);
+    UnmapViewOfFile(pMem->pBuffer);
+    CloseHandle((HANDLE)pMem->hMapping);
+}
+
+#else
+
+static uint32_t mirror_granularity()
+{
+    return (uint32_t)sysconf(_SC_PAGESIZE);
+}
+
+static bool mirror_alloc(RingMemory *pMem, uint32_t nSize)
+{
+#ifdef __linux__
+    int fd = memfd_create("ringbuffer", MFD_CLOEXEC);
+#else
+    char szName[64];
+    snprintf(szName, sizeof(szName), "/ringbuffer-%d-%p", (int)getpid(), (void*)pMem);
+    int fd = shm_open(szName, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if(fd >= 0)
+        shm_unlink(szName);
+#endif
+    if(fd < 0)
+        return false;
+
+    if(ftruncate(fd, nSize) != 0) {
+        close(fd);
+        return false;
+    }
+
+    //先占住2n的地址空间, 再用MAP_FIXED把同一个文件映射到前后两半
+    uint8_t *p = (uint8_t*)mmap(NULL, (size_t)nSize * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(p == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    if(mmap(p, nSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+       mmap(p + nSize, nSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(p, (size_t)nSize * 2);
+        close(fd);
+        return false;
+    }
+
+    //映射已经持有文件的引用
+    close(fd);
+
+    pMem->pBuffer = p;
+    return true;
+}
+
+static void mirror_free(RingMemory *pMem)
+{
+    munmap(pMem->pBuffer, (size_t)pMem->nSize * 2);
+}
+
+#endif
+
+#ifdef _WIN32
+
+static bool page_alloc(RingMemory *pMem, uint32_t nSize, uint32_t nFlags)
+{
+    if(nFlags & RING_ALLOC_HUGEPAGE) {
+        //需要SeLockMemoryPrivilege权限
+        SIZE_T nLarge = GetLargePageMinimum();
+        if(nLarge) {
+            SIZE_T nLen = (nSize + nLarge - 1) / nLarge * nLarge;
+            DWORD dwType = MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES;
+            void *p = (nFlags & RING_ALLOC_NUMA)
+                ? VirtualAllocExNuma(GetCurrentProcess(), NULL, nLen, dwType, PAGE_READWRITE, RING_ALLOC_NODE_OF(nFlags))
+                : VirtualAlloc(NULL, nLen, dwType, PAGE_READWRITE);
+            if(p) {
+                pMem->pBuffer = (uint8_t*)p;
+                pMem->nMapLen = nLen;
+                pMem->nFlags |= RING_ALLOC_HUGEPAGE | (nFlags & RING_ALLOC_NUMA);
+                return true;
+            }
+        }
+    }
+
+    if(nFlags & RING_ALLOC_NUMA) {
+        void *p = VirtualAllocExNuma(GetCurrentProcess(), NULL, nSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, RING_ALLOC_NODE_OF(nFlags));
+        if(p) {
+            pMem->pBuffer = (uint8_t*)p;
+            pMem->nMapLen = nSize;
+            pMem->nFlags |= RING_ALLOC_NUMA;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void page_free(RingMemory *pMem)
+{
+    VirtualFree(pMem->pBuffer, 0, MEM_RELEASE);
+}
+
+static bool lock_pages(void *p, size_t nLen)
+{
+    return VirtualLock(p, nLen) != 0;
+}
+
+static void unlock_pages(void *p, size_t nLen)
+{
+    VirtualUnlock(p, nLen);
+}
+
+static bool bind_node(void *, size_t, uint32_t)
+{
+    //Windows下只能在分配时指定节点
+    return false;
+}
+
+#else
+
+static bool bind_node(void *p, size_t nLen, uint32_t nNode)
+{
+#ifdef __linux__
+    unsigned long aMask[16] = { 0 };
+    if(nNode >= sizeof(aMask) * 8)
+        return false;
+
+    aMask[nNode / (sizeof(unsigned long) * 8)] = 1UL << (nNode % (sizeof(unsigned long) * 8));
+
+    return syscall(SYS_mbind, p, nLen, RING_MPOL_BIND, aMask, sizeof(aMask) * 8, RING_MPOL_MF_MOVE) == 0;
+#else
+    (void)p; (void)nLen; (void)nNode;
+    return false;
+#endif
+}
+
+static bool page_alloc(RingMemory *pMem, uint32_t nSize, uint32_t nFlags)
+{
+    void *p = MAP_FAILED;
+    size_t nLen = nSize;
+
+    if(nFlags & RING_ALLOC_HUGEPAGE) {
+        nLen = (nSize + RING_HUGEPAGE_SIZE - 1) / RING_HUGEPAGE_SIZE * RING_HUGEPAGE_SIZE;
+#ifdef MAP_HUGETLB
+        //需要预留hugetlb页(/proc/sys/vm/nr_hugepages)
+        p = mmap(NULL, nLen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+        if(p == MAP_FAILED) {
+            p = mmap(NULL, nLen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+            //没有预留大页时请求透明大页, 内核不一定满足
+            if(p != MAP_FAILED && madvise(p, nLen, MADV_HUGEPAGE) != 0)
+                nFlags &= ~RING_ALLOC_HUGEPAGE;
+#else
+            nFlags &= ~RING_ALLOC_HUGEPAGE;
+#endif
+        }
+    } else {
+        p = mmap(NULL, nLen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+
+    if(p == MAP_FAILED)
+        return false;
+
+    pMem->pBuffer = (uint8_t*)p;
+    pMem->nMapLen = nLen;
+    pMem->nFlags |= nFlags & RING_ALLOC_HUGEPAGE;
+
+    return true;
+}
+
+static void page_free(RingMemory *pMem)
+{
+    munmap(pMem->pBuffer, pMem->nMapLen);
+}
+
+static bool lock_pages(void *p, size_t nLen)
+{
+    return mlock(p, nLen) == 0;
+}
+
+static void unlock_pages(void *p, size_t nLen)
+{
+    munlock(p, nLen);
+}
+
+#endif
+
+static void prefault_pages(uint8_t *p, size_t nLen)
+{
+    //每页写一个字节就会分配物理页; volatile防止被优化掉
+    volatile uint8_t *v = p;
+    for(size_t i = 0; i < nLen; i += 4096)
+        v[i] = 0;
+    if(nLen)
+        v[nLen - 1] = 0;
+}
+
+bool ring_alloc(RingMemory *pMem, uint32_t nSize, uint32_t nFlags)
+{
+    memset(pMem, 0, sizeof(RingMemory));
+
+    if(nFlags & RING_ALLOC_MIRRORED) {
+        uint32_t nGranularity = mirror_granularity();
+        uint32_t nMirror = nSize < nGranularity ? nGranularity : nSize;
+
+        if(mirror_alloc(pMem, nMirror)) {
+            pMem->nSize  = nMirror;
+            pMem->nFlags = RING_ALLOC_MIRRORED;
+        }
+    }
+
+    if(!pMem->pBuffer && (nFlags & (RING_ALLOC_HUGEPAGE | RING_ALLOC_NUMA)) && page_alloc(pMem, nSize, nFlags)) {
+        //大页时实际长度是大页的整数倍, 仍然是2的次方
+        pMem->nSize = pMem->nMapLen > nSize && pMem->nMapLen <= 0x80000000U ? (uint32_t)pMem->nMapLen : nSize;
+    }
+
+    if(!pMem->pBuffer) {
+        pMem->pBuffer = (uint8_t*)malloc(nSize);
+        pMem->nSize   = nSize;
+        pMem->nFlags  = RING_ALLOC_HEAP;
+    }
+
+    if(!pMem->pBuffer)
+        return false;
+
+    //必须在第一次访问之前绑定节点, 之后mlock和预先访问分配的物理页才会落在这个节点上
+    //malloc的内存不是按页对齐的, 不能绑定
+    if((nFlags & RING_ALLOC_NUMA) && !(pMem->nFlags & RING_ALLOC_NUMA) &&
+       (pMem->nMapLen || (pMem->nFlags & RING_ALLOC_MIRRORED)) &&
+       bind_node(pMem->pBuffer, pMem->nSize, RING_ALLOC_NODE_OF(nFlags)))
+        pMem->nFlags |= RING_ALLOC_NUMA;
+
+    if(pMem->nFlags & RING_ALLOC_NUMA)
+        pMem->nFlags |= nFlags & 0xFFFF0000U;
+
+    if((nFlags & RING_ALLOC_MLOCK) && lock_pages(pMem->pBuffer, pMem->nSize))
+        pMem->nFlags |= RING_ALLOC_MLOCK;
+
+    if(nFlags & RING_ALLOC_PREFAULT) {
+        prefault_pages(pMem->pBuffer, pMem->nSize);
+        pMem->nFlags |= RING_ALLOC_PREFAULT;
+    }
+
+    return true;
+}
+
+void ring_free(RingMemory *pMem)
+{
+    if(!pMem->pBuffer)
+        return;
+
+    if(pMem->nFlags & RING_ALLOC_MLOCK)
+        unlock_pages(pMem->pBuffer, pMem->nSize);
+
+    if(pMem->nFlags & RING_ALLOC_MIRRORED)
+        mirror_free(pMem);
+    else if(pMem->nMapLen)
+        page_free(pMem);
+    else
+        free(pMem->pBuffer);
+
+    pMem->pBuffer = NULL;
+}
@@ -0,0 +1,42 @@
+#ifndef RINGMEMORY_H
+#define RINGMEMORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//环形缓冲区存储的分配方式
+enum RingAllocFlag
+{
+    RING_ALLOC_HEAP     = 0,
+    //同一块物理内存在虚拟地址上连续映射两次, 任意位置开始的m_nSize字节都是连续的
+    RING_ALLOC_MIRRORED = 1 << 0,
+    //大页(Linux 2MB hugetlb, 不行时退回透明大页; Windows large page), 大小向上取整到大页大小
+    RING_ALLOC_HUGEPAGE = 1 << 1,
+    //锁定在物理内存中不被换出(mlock/VirtualLock), 受RLIMIT_MEMLOCK等限制, 可能失败
+    RING_ALLOC_MLOCK    = 1 << 2,
+    //构造时就把每一页都写一遍, 避免运行中第一次访问时缺页
+    RING_ALLOC_PREFAULT = 1 << 3,
+    //绑定到RING_ALLOC_NODE()指定的NUMA节点, 一般选消费者线程所在的节点
+    RING_ALLOC_NUMA     = 1 << 4,
+};
+
+//NUMA节点号放在nFlags的高16位: RING_ALLOC_NODE(1) | RING_ALLOC_PREFAULT
+#define RING_ALLOC_NODE(node)       (RING_ALLOC_NUMA | ((uint32_t)(node) << 16))
+#define RING_ALLOC_NODE_OF(flags)   ((flags) >> 16)
+
+struct RingMemory
+{
+    uint8_t  *pBuffer;
+    uint32_t  nSize;    //实际大小, 镜像映射时会向上取整到页(分配粒度)大小
+    uint32_t  nFlags;   //实际生效的分配方式, 系统不支持的选项会被去掉, 都不支持时为RING_ALLOC_HEAP
+    size_t    nMapLen;  //直接向系统申请的页的长度, 0表示用的是malloc
+#ifdef _WIN32
+    void     *hMapping;
+#endif
+};
+
+//分配nSize(2的次方)字节的存储, 失败时pBuffer为NULL
+bool ring_alloc(RingMemory *pMem, uint32_t nSize, uint32_t nFlags);
+void ring_free(RingMemory *pMem);
+
+#endif // RINGMEMORY_H
@@ -0,0 +1,541 @@
+/*
+ * =====================================================================================
+ *       Filename:  ringtest.cpp
+ *
+ *    Description:  环形缓冲区和线程池的回归用例
+ *         Others:  1.每个用例是一个返回bool的函数, RING_CHECK失败时打印位置并返回false.
+ *                  2.涉及阻塞的用例都带超时, 出问题时失败而不是卡住.
+ * =====================================================================================
+ */
+
+#include "ringtest.h"
+#include "ringbuffer.h"
+#include "basicringbuffer.h"
+#include "staticringbuffer.h"
+#include "frameringbuffer.h"
+#include "ThreadPool.h"
+#include "TaskGraph.h"
+#include "PoolAllocator.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#ifndef _WIN32
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+#define RING_CHECK(cond) \
+    do { \
+        if(!(cond)) { \
+            printf("    %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            return false; \
+        } \
+    } while(0)
+
+//两个消费者的nMinFill不同, 少量数据到来时要叫醒要求少的那个
+static bool testMixedMinFill()
+{
+    RingBuffer ring(8192);
+    std::atomic<uint32_t> nSmall(UINT32_MAX), nBig(UINT32_MAX);
+
+    std::thread big([&] {
+        uint8_t buf[4096];
+        nBig = ring.get(buf, sizeof(buf), sizeof(buf), std::chrono::steady_clock::now() + std::chrono::milliseconds(1000));
+    });
+    //要求多的先进入等待, notify_one会先叫醒它
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::thread small([&] {
+        uint8_t buf[16];
+        nSmall = ring.get(buf, sizeof(buf), 1, std::chrono::steady_clock::now() + std::chrono::milliseconds(1000));
+    });
+
+    //两个都阻塞住以后再写1个字节
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    uint8_t c = 'x';
+    ring.put(&c, 1);
+
+    small.join();
+    big.join();
+    RING_CHECK(nSmall == 1);
+    RING_CHECK(nBig == 0);
+    return true;
+}
+
+//两个生产者在小缓冲区上阻塞putv, 每条记录的几段必须连在一起, 不能被另一个生产者插进来
+static bool testPutvBlockAtomic()
+{
+    const int nRecords = 2000;
+    const uint32_t nRecLen = 1 + 4 + 20;
+    RingBuffer ring(64);
+    std::atomic<int> nDone(0);
+
+    auto produce = [&](uint8_t id) {
+        uint8_t payload[20];
+        memset(payload, id, sizeof(payload));
+        for(uint32_t i = 0; i < nRecords; i++) {
+            RingSpan aSeg[3] = { { &id, 1 }, { (uint8_t*)&i, 4 }, { payload, sizeof(payload) } };
+            ring.putv(aSeg, 3, RING_PUT_BLOCK);
+        }
+        nDone++;
+    };
+    std::thread a(produce, (uint8_t)'a');
+    std::thread b(produce, (uint8_t)'b');
+
+    uint32_t aNext[2] = { 0, 0 };
+    bool bOk = true;
+    for(int i = 0; i < 2 * nRecords && bOk; i++) {
+        uint8_t rec[nRecLen];
+        uint32_t nSeq;
+        bOk = ring.get(rec, nRecLen, nRecLen, std::chrono::steady_clock::now() + std::chrono::seconds(5)) == nRecLen;
+        bOk = bOk && (rec[0] == 'a' || rec[0] == 'b');
+        memcpy(&nSeq, rec + 1, 4);
+        bOk = bOk && nSeq == aNext[rec[0] - 'a']++;
+        for(uint32_t k = 5; k < nRecLen && bOk; k++)
+            bOk = rec[k] == rec[0];
+    }
+
+    //出错时读空剩下的, 让生产者能结束
+    while(nDone < 2) {
+        uint8_t rest[64];
+        ring.get(rest, sizeof(rest), 1, std::chrono::steady_clock::now() + std::chrono::milliseconds(10));
+    }
+    a.join();
+    b.join();
+    RING_CHECK(bOk);
+
+    //比整个缓冲区还大的putv永远放不下, 直接丢弃而不是写一半
+    uint8_t big[65] = { 0 };
+    RingSpan seg = { big, sizeof(big) };
+    RING_CHECK(ring.putv(&seg, 1, RING_PUT_BLOCK) == 0);
+    RING_CHECK(ring.dropped() == sizeof(big) && ring.length() == 0);
+    return true;
+}
+
+//阻塞的读写者在resize之后要按新大小判断: 缩小后要求整个旧缓冲区的消费者等到新缓冲区满就返回, 变大后阻塞的生产者继续写
+static bool testResizeBlocked()
+{
+    typedef std::chrono::steady_clock Clock;
+
+    RingBuffer ring(1024);
+    uint8_t buf[1024] = { 0 };
+    RING_CHECK(ring.put(buf, 200) == 200);
+
+    std::atomic<uint32_t> nGot(UINT32_MAX);
+    Clock::time_point done;
+    std::thread reader([&] {
+        uint8_t data[1024];
+        nGot = ring.get(data, sizeof(data), sizeof(data), Clock::now() + std::chrono::seconds(3));
+        done = Clock::now();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    RING_CHECK(ring.resize(256));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    Clock::time_point start = Clock::now();
+    RING_CHECK(ring.put(buf, 56) == 56);
+    reader.join();
+    RING_CHECK(nGot == 256);
+    RING_CHECK(done - start < std::chrono::seconds(1));
+
+    RingBuffer full(64);
+    RING_CHECK(full.put(buf, 64) == 64);
+
+    std::atomic<uint32_t> nPut(UINT32_MAX);
+    std::thread writer([&] {
+        nPut = full.put(buf, 100, Clock::now() + std::chrono::seconds(3));
+        done = Clock::now();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    start = Clock::now();
+    RING_CHECK(full.resize(256));
+    writer.join();
+    RING_CHECK(nPut == 100 && full.length() == 164);
+    RING_CHECK(done - start < std::chrono::seconds(1));
+    return true;
+}
+
+#ifndef _WIN32
+//readFrom/writeTo: 缓冲区满或者空时返回0且不动errno, 只有真正的I/O错误才返回-1
+static bool testFdTransfer()
+{
+    int fds[2];
+    RING_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    RingBuffer ring(64);
+    uint8_t buf[64] = { 0 };
+    RING_CHECK(write(fds[1], buf, sizeof(buf)) == (ssize_t)sizeof(buf));
+    RING_CHECK(ring.readFrom(fds[0]) == 64);
+
+    errno = 0;
+    RING_CHECK(ring.readFrom(fds[0]) == 0 && errno == 0);
+
+    RING_CHECK(ring.writeTo(fds[1]) == 64);
+    RING_CHECK(ring.writeTo(fds[1]) == 0 && errno == 0);
+    RING_CHECK(read(fds[0], buf, sizeof(buf)) == (ssize_t)sizeof(buf));
+
+    close(fds[0]);
+    RING_CHECK(ring.put(buf, 8) == 8);
+    RING_CHECK(ring.readFrom(fds[0]) == -1 && errno == EBADF);
+    close(fds[1]);
+    return true;
+}
+#endif
+
+//RING_PUT_BLOCK的背压: 缓冲区满时生产者停下来等, 消费者读走多少它写多少, 数据不丢不乱
+static bool testPutBlockBackpressure()
+{
+    RingBuffer ring(64);
+    uint8_t data[1000];
+    for(uint32_t i = 0; i < sizeof(data); i++)
+        data[i] = (uint8_t)(i * 7);
+
+    std::atomic<uint32_t> nPut(UINT32_MAX);
+    std::thread writer([&] { nPut = ring.put(data, sizeof(data), RING_PUT_BLOCK); });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    bool bBlocked = nPut == UINT32_MAX && ring.length() == 64;
+
+    uint8_t out[1000];
+    uint32_t nGot = 0;
+    while(nGot < sizeof(out)) {
+        uint32_t n = ring.get(out + nGot, 48, 1, std::chrono::steady_clock::now() + std::chrono::seconds(5));
+        if(!n)
+            break;
+        nGot += n;
+    }
+    writer.join();
+
+    RingStats stats;
+    ring.stats(&stats);
+    RING_CHECK(bBlocked);
+    RING_CHECK(nPut == sizeof(data) && nGot == sizeof(out));
+    RING_CHECK(memcmp(out, data, sizeof(data)) == 0);
+    RING_CHECK(stats.nPutWaits > 0 && stats.nDropped == 0);
+    return true;
+}
+
+//RING_NOTIFY_WATERMARK: 水位线以下不唤醒消费者; RING_NOTIFY_FLUSH: 只有flush唤醒
+static bool testNotifyPolicy()
+{
+    typedef std::chrono::steady_clock Clock;
+
+    RingBuffer ring(1024);
+    uint8_t buf[100] = { 0 };
+    std::atomic<uint32_t> nGot(UINT32_MAX);
+
+    ring.setNotify(RING_NOTIFY_WATERMARK, 100);
+    std::thread reader([&] {
+        uint8_t data[1024];
+        nGot = ring.get(data, sizeof(data), 1, Clock::now() + std::chrono::seconds(3));
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ring.put(buf, 10);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    bool bHeld = nGot == UINT32_MAX;
+    ring.put(buf, 90);
+    reader.join();
+    RING_CHECK(bHeld);
+    RING_CHECK(nGot == 100);
+
+    nGot = UINT32_MAX;
+    ring.setNotify(RING_NOTIFY_FLUSH);
+    Clock::time_point done;
+    std::thread flushed([&] {
+        uint8_t data[1024];
+        nGot = ring.get(data, sizeof(data), 1, Clock::now() + std::chrono::seconds(3));
+        done = Clock::now();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ring.put(buf, 100);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    bHeld = nGot == UINT32_MAX;
+    Clock::time_point start = Clock::now();
+    ring.flush();
+    flushed.join();
+    RING_CHECK(bHeld);
+    RING_CHECK(nGot == 100 && done - start < std::chrono::seconds(1));
+    return true;
+}
+
+#ifndef _WIN32
+static bool fd_ready(int fd)
+{
+    struct pollfd pfd = { fd, POLLIN, 0 };
+
+    return poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN);
+}
+
+//readableFd/writableFd按阈值水平触发, 数据量变化后跟着变
+static bool testEventFds()
+{
+    RingBuffer ring(64);
+    RING_CHECK(ring.enableEvents(16, 32));
+
+    RING_CHECK(!fd_ready(ring.readableFd()) && fd_ready(ring.writableFd()));
+
+    uint8_t buf[64] = { 0 };
+    ring.put(buf, 15);
+    RING_CHECK(!fd_ready(ring.readableFd()));
+    ring.put(buf, 1);
+    RING_CHECK(fd_ready(ring.readableFd()) && fd_ready(ring.writableFd()));
+
+    //空闲空间32以下
+    ring.put(buf, 20);
+    RING_CHECK(fd_ready(ring.readableFd()) && !fd_ready(ring.writableFd()));
+
+    RING_CHECK(ring.get(buf, 30) == 30);
+    RING_CHECK(!fd_ready(ring.readableFd()) && fd_ready(ring.writableFd()));
+
+    //阈值超过缩小后的大小时按缓冲区满算: 剩下6字节, 缩到8字节后再写2字节才可读
+    RING_CHECK(ring.resize(8));
+    RING_CHECK(!fd_ready(ring.readableFd()) && !fd_ready(ring.writableFd()));
+    ring.put(buf, 2);
+    RING_CHECK(fd_ready(ring.readableFd()) && !fd_ready(ring.writableFd()));
+    RING_CHECK(ring.get(buf, 8) == 8);
+    RING_CHECK(!fd_ready(ring.readableFd()) && fd_ready(ring.writableFd()));
+    return true;
+}
+#endif
+
+//BasicRingBuffer/StaticRingBuffer共用RingBufferCore: 大小取整、覆盖统计、唤醒策略和RingBuffer一致
+static bool testRingCore()
+{
+    BasicRingBuffer<uint32_t> zero(0);
+    RING_CHECK(zero.size() == 1);
+
+    BasicRingBuffer<uint16_t> narrow(8);
+    uint8_t buf[32] = { 0 };
+    for(int i = 0; i < 20000; i++) {
+        RING_CHECK(narrow.put(buf, 5) == 5);
+        RING_CHECK(narrow.get(buf, 5) == 5);
+    }
+
+    StaticRingBuffer<16> ring;
+    RING_CHECK(ring.put(buf, 12) == 12);
+    RING_CHECK(ring.put(buf, 8, RING_PUT_OVERWRITE) == 8);
+    RING_CHECK(ring.overwritten() == 4 && ring.length() == 16);
+    RING_CHECK(ring.put(buf, 20, RING_PUT_OVERWRITE) == 16);
+    RING_CHECK(ring.overwritten() == 4 + 4 + 16);
+    RING_CHECK(ring.put(buf, 1, RING_PUT_FAIL) == 0 && ring.dropped() == 1);
+    ring.reset();
+
+    //和RingBuffer一样, 要求少的消费者不会因为要求多的先睡而收不到唤醒
+    StaticRingBuffer<8192> wait;
+    std::atomic<uint32_t> nSmall(UINT32_MAX);
+    std::thread big([&] {
+        uint8_t data[4096];
+        wait.get(data, sizeof(data), sizeof(data));
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::thread small([&] {
+        uint8_t data[16];
+        nSmall = wait.get(data, sizeof(data), 1);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    wait.put(buf, 1);
+
+    for(int i = 0; i < 100 && nSmall == UINT32_MAX; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    bool bWoken = nSmall == 1;
+
+    //喂够数据放走要求多的那个
+    uint8_t data[4096] = { 0 };
+    wait.put(data, sizeof(data));
+    big.join();
+    small.join();
+    RING_CHECK(bWoken);
+    return true;
+}
+
+//bool/char的partial挨在一起时各线程写自己的slot会互相踩
+static bool testReduceSmallTypes()
+{
+    ThreadPool pool(4);
+    pool.init();
+
+    for(int i = 0; i < 200; i++) {
+        bool bAll = pool.parallel_reduce(0, 10000, 16, true, [](size_t n) { return n != 5000; }, [](bool a, bool b) { return a && b; });
+        bool bAny = pool.parallel_reduce(0, 10000, 16, false, [](size_t n) { return n == 9999; }, [](bool a, bool b) { return a || b; });
+        char nMax = pool.parallel_reduce(0, 10000, 16, (char)0, [](size_t n) { return (char)(n % 100); }, [](char a, char b) { return a > b ? a : b; });
+        RING_CHECK(!bAll);
+        RING_CHECK(bAny);
+        RING_CHECK(nMax == 99);
+    }
+    return true;
+}
+
+//线程池销毁时丢掉的任务要让句柄失败, 不能让get()一直等
+static bool testDroppedTaskHandles()
+{
+    TaskHandle<int> h, h2;
+    TaskHandle<void> g;
+    {
+        //不init, 任务全部留在队列里随线程池销毁
+        ThreadPool pool(1);
+        h = spawn(pool, [] { return 1; });
+        h2 = h.then([](int n) { return n + 1; });
+
+        TaskGraph graph;
+        graph.precede(graph.add([] {}), graph.add([] {}));
+        g = graph.run(pool);
+    }
+
+    bool bBroken = false;
+    try { h2.get(); } catch(const std::future_error &) { bBroken = true; }
+    RING_CHECK(bBroken && h.ready());
+
+    bBroken = false;
+    try { g.get(); } catch(const std::future_error &) { bBroken = true; }
+    RING_CHECK(bBroken);
+
+    bool bThrown = false;
+    try { when_any(std::vector<TaskHandle<int>>()).get(); } catch(const std::invalid_argument &) { bThrown = true; }
+    RING_CHECK(bThrown);
+
+    TaskGraph graph;
+    bThrown = false;
+    try { graph.precede(0, 1); } catch(const std::out_of_range &) { bThrown = true; }
+    RING_CHECK(bThrown);
+    return true;
+}
+
+//优先级参数: 左值的TaskPriority走带优先级的重载, 超出范围的抛异常; 过了deadline的任务计入expired()
+static bool testPoolPriority()
+{
+    ThreadPool pool(2);
+    pool.init();
+
+    std::atomic<int> nRan(0);
+    TaskPriority priority = PRIORITY_CRITICAL;
+    pool.post(priority, [&] { nRan++; });
+    pool.post(priority, [&](int n) { nRan += n; }, 2);
+
+    bool bThrown = false;
+    try { pool.post((TaskPriority)PRIORITY_COUNT, [&] { nRan++; }); } catch(const std::out_of_range &) { bThrown = true; }
+    RING_CHECK(bThrown);
+
+    ThreadPool::Clock::time_point past = ThreadPool::Clock::now() - std::chrono::seconds(1);
+    pool.post(PRIORITY_NORMAL, past, [&] { nRan += 100; });
+    std::future<int> late = pool.submit(PRIORITY_NORMAL, past, [] { return 1; });
+
+    bool bExpired = false;
+    try { late.get(); } catch(const TaskExpired &) { bExpired = true; }
+    RING_CHECK(bExpired);
+
+    for(int i = 0; i < 500 && (nRan < 3 || pool.expired() < 2); i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    RING_CHECK(nRan == 3 && pool.expired() == 2);
+    return true;
+}
+
+//0字节的分配走最小的块, 不能用第0个class去取bucket
+static bool testPoolAllocatorZero()
+{
+    PoolAllocator<int> alloc;
+    int *p = alloc.allocate(0);
+    int *q = alloc.allocate(0);
+    RING_CHECK(p && q && p != q);
+    alloc.deallocate(p, 0);
+    alloc.deallocate(q, 0);
+
+    struct Empty {};
+    PoolAllocator<Empty> empty;
+    empty.deallocate(empty.allocate(1), 1);
+    return true;
+}
+
+//post的任务抛异常时工作线程要接着跑后面的任务, 异常计数到failed()
+static bool testThrowingPost()
+{
+    ThreadPool pool(2);
+    pool.init();
+
+    for(int i = 0; i < 10; i++)
+        pool.post([] { throw std::runtime_error("post"); });
+
+    std::future<int> f = pool.submit([] { return 7; });
+    RING_CHECK(f.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    RING_CHECK(f.get() == 7);
+
+    for(int i = 0; i < 500 && pool.failed() < 10; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    RING_CHECK(pool.failed() == 10);
+    return true;
+}
+
+//上一条记录没release时pop要失败, 不能阻塞或者再给出同一条
+static bool testFramePending()
+{
+    FrameRingBuffer frame(256);
+    RING_CHECK(frame.try_push_record("ab", 2));
+    RING_CHECK(frame.try_push_record("cde", 3));
+
+    RingSpan view, other;
+    RING_CHECK(frame.try_pop_record(view) && view.nLen == 2);
+    RING_CHECK(!frame.try_pop_record(other));
+    RING_CHECK(!frame.pop_record(other));
+
+    //clear保留还在读的那一条
+    frame.clear();
+    RING_CHECK(frame.records() == 1 && memcmp(view.pData, "ab", 2) == 0);
+
+    frame.release_record();
+    frame.release_record();
+    RING_CHECK(frame.records() == 0 && !frame.try_pop_record(other));
+
+    RING_CHECK(frame.try_push_record("f", 1));
+    RING_CHECK(frame.pop_record(view) && view.nLen == 1 && *view.pData == 'f');
+    frame.release_record();
+    return true;
+}
+
+struct RingTestCase
+{
+    const char *pName;
+    bool (*pfnRun)();
+};
+
+static const RingTestCase s_aTests[] = {
+    { "mixed_min_fill", testMixedMinFill },
+    { "ring_core", testRingCore },
+    { "putv_block_atomic", testPutvBlockAtomic },
+    { "resize_blocked", testResizeBlocked },
+    { "put_block_backpressure", testPutBlockBackpressure },
+    { "notify_policy", testNotifyPolicy },
+#ifndef _WIN32
+    { "fd_transfer", testFdTransfer },
+    { "event_fds", testEventFds },
+#endif
+    { "reduce_small_types", testReduceSmallTypes },
+    { "dropped_task_handles", testDroppedTaskHandles },
+    { "throwing_post", testThrowingPost },
+    { "pool_priority", testPoolPriority },
+    { "pool_allocator_zero", testPoolAllocatorZero },
+    { "frame_pending", testFramePending },
+};
+
+int ringTest(int argc, char* argv[])
+{
+    const char *pFilter = argc > 1 ? argv[1] : NULL;
+    int nFailed = 0;
+
+    for(const RingTestCase &t : s_aTests) {
+        if(pFilter && strcmp(pFilter, t.pName) != 0)
+            continue;
+
+        bool bOk = t.pfnRun();
+        printf("%-24s %s\n", t.pName, bOk ? "ok" : "FAILED");
+        if(!bOk)
+            nFailed++;
+    }
+
+    return nFailed ? 1 : 0;
+}
@@ -0,0 +1,8 @@
+#ifndef RINGTEST_H
+#define RINGTEST_H
+
+//自检: iRingBuffer test [用例名]
+//逐个运行回归用例, 输出每个用例的结果; 全部通过返回0
+int ringTest(int argc, char* argv[]);
+
+#endif // RINGTEST_H
@@ -0,0 +1,92 @@
+#ifndef RINGUTIL_H
+#define RINGUTIL_H
+
+#include <stdint.h>
+
+//缓存行大小, 用于隔开生产者和消费者各自频繁修改的索引, 避免伪共享
+#define RING_CACHELINE_SIZE 64
+
+//判断x是否是2的次方
+#define is_power_of_two(x) ((x) != 0 && (((x) & ((x) - 1)) == 0))
+//取比n大最小2的次方值 (n本身是2的次方时也会翻倍, 调用前先用is_power_of_two判断; 最高支持到bit 31)
+#define roundup_pow_of_two(n)      \
+    (1UL    <<                     \
+    (                              \
+    (                              \
+    (n) & (1UL << 31) ? 31 :       \
+    (n) & (1UL << 30) ? 30 :       \
+    (n) & (1UL << 29) ? 29 :       \
+    (n) & (1UL << 28) ? 28 :       \
+    (n) & (1UL << 27) ? 27 :       \
+    (n) & (1UL << 26) ? 26 :       \
+    (n) & (1UL << 25) ? 25 :       \
+    (n) & (1UL << 24) ? 24 :       \
+    (n) & (1UL << 23) ? 23 :       \
+    (n) & (1UL << 22) ? 22 :       \
+    (n) & (1UL << 21) ? 21 :       \
+    (n) & (1UL << 20) ? 20 :       \
+    (n) & (1UL << 19) ? 19 :       \
+    (n) & (1UL << 18) ? 18 :       \
+    (n) & (1UL << 17) ? 17 :       \
+    (n) & (1UL << 16) ? 16 :       \
+    (n) & (1UL << 15) ? 15 :       \
+    (n) & (1UL << 14) ? 14 :       \
+    (n) & (1UL << 13) ? 13 :       \
+    (n) & (1UL << 12) ? 12 :       \
+    (n) & (1UL << 11) ? 11 :       \
+    (n) & (1UL << 10) ? 10 :       \
+    (n) & (1UL <<  9) ?  9 :       \
+    (n) & (1UL <<  8) ?  8 :       \
+    (n) & (1UL <<  7) ?  7 :       \
+    (n) & (1UL <<  6) ?  6 :       \
+    (n) & (1UL <<  5) ?  5 :       \
+    (n) & (1UL <<  4) ?  4 :       \
+    (n) & (1UL <<  3) ?  3 :       \
+    (n) & (1UL <<  2) ?  2 :       \
+    (n) & (1UL <<  1) ?  1 :       \
+    (n) & (1UL <<  0) ?  0 : -1    \
+    ) + 1                          \
+    )                              \
+    )
+
+//64位版本: 取不小于n的最小2的次方值(n本身是2的次方时返回n, 0时返回1), 最高支持到bit 63
+static inline uint64_t roundup_pow_of_two64(uint64_t n)
+{
+    //0按1处理, 和roundup_pow_of_two一样
+    if(!n)
+        return 1;
+
+    n--;
+    n |= n >> 1;
+    n |= n >> 2;
+    n |= n >> 4;
+    n |= n >> 8;
+    n |= n >> 16;
+    n |= n >> 32;
+
+    return n + 1;
+}
+
+//环形缓冲区中的一段连续内存(类似iovec), 回环时一次读写最多拆成两段
+struct RingSpan
+{
+    uint8_t  *pData;
+    uint32_t  nLen;
+};
+
+//把从索引nIdx开始的nLen字节拆成最多两段连续内存, 返回nLen
+//镜像映射的存储(bMirrored)不需要拆分, 第二段长度总是0
+static inline uint32_t ring_spans(uint8_t *pBuffer, uint32_t nSize, uint32_t nIdx, uint32_t nLen, RingSpan aSpan[2], bool bMirrored = false)
+{
+    uint32_t nOff  = nIdx & (nSize - 1);
+    uint32_t nPart = (bMirrored || nLen < nSize - nOff) ? nLen : nSize - nOff;
+
+    aSpan[0].pData = pBuffer + nOff;
+    aSpan[0].nLen  = nPart;
+    aSpan[1].pData = pBuffer;
+    aSpan[1].nLen  = nLen - nPart;
+
+    return nLen;
+}
+
+#endif // RINGUTIL_H
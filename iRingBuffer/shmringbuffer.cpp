@@ -0,0 +1,425 @@
+/*
+ * =====================================================================================
+ *       Filename:  shmringbuffer.cpp
+ *
+ *    Description:  跨进程共享内存环形缓冲区
+ *         Others:  1.布局: [ShmRingHeader][填充到页边界][数据区nSize], 用shm_open + mmap映射.
+ *                  2.创建者先ftruncate再填头部, 最后release写入nMagic; 打开者看到nMagic才认为可用.
+ *                    初始化和接入都在共享内存fd的flock里做, 初始化到一半崩溃时锁随进程释放,
+ *                    后来者拿到锁还看不到nMagic就重新初始化, 不会永远打不开.
+ *                  3.等待: Linux下直接在nIn/nOut上用进程间futex等待, 对端只有在waiting标志置位时才wake,
+ *                    没有人等的时候put/get不进内核; 其他系统退化为定时轮询.
+ *                  4.角色用pid和进程启动时间登记, 登记的进程已经不存在(kill(pid, 0)返回ESRCH)
+ *                    或者pid已经被别的进程复用(启动时间不同)时可以被新进程接管.
+ * =====================================================================================
+ */
+
+#ifndef _WIN32
+
+#include "shmringbuffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __APPLE__
+#include <sys/sysctl.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#include <chrono>
+
+//取a和b中最小值
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "shared memory ring needs lock-free 32-bit atomics");
+
+//进程的启动时间(只用来比较是否相同), 取不到时返回0
+static uint32_t process_start(uint32_t nPid)
+{
+#if defined(__linux__)
+    char szPath[64];
+    snprintf(szPath, sizeof(szPath), "/proc/%u/stat", nPid);
+
+    FILE *fp = fopen(szPath, "r");
+    if(!fp)
+        return 0;
+
+    char szStat[1024];
+    size_t nLen = fread(szStat, 1, sizeof(szStat) - 1, fp);
+    fclose(fp);
+    szStat[nLen] = 0;
+
+    //第2个字段comm里可能有空格和括号, 从最后一个')'往后数, 启动时间是第22个字段
+    const char *p = strrchr(szStat, ')');
+    for(int i = 0; i < 20 && p; i++)
+        p = strchr(p + 1, ' ');
+
+    unsigned long long nStart = 0;
+    if(!p || sscanf(p, " %llu", &nStart) != 1)
+        return 0;
+
+    return (uint32_t)nStart;
+#elif defined(__APPLE__)
+    struct kinfo_proc info;
+    size_t nLen = sizeof(info);
+    int mib[4] = { CTL_KERN, KERN_PROC, KERN_PROC_PID, (int)nPid };
+
+    if(sysctl(mib, 4, &info, &nLen, NULL, 0) != 0 || nLen == 0)
+        return 0;
+
+    return (uint32_t)info.kp_proc.p_starttime.tv_sec * 1000000U + (uint32_t)info.kp_proc.p_starttime.tv_usec;
+#else
+    (void)nPid;
+    return 0;
+#endif
+}
+
+//nStart为登记时的启动时间; 任何一边取不到启动时间时只看pid
+static bool process_alive(uint32_t nPid, uint32_t nStart)
+{
+    if(!nPid)
+        return false;
+
+    if(kill((pid_t)nPid, 0) != 0 && errno != EPERM)
+        return false;
+
+    uint32_t nNow = nStart ? process_start(nPid) : 0;
+
+    return !nNow || nNow == nStart;
+}
+
+ShmRingBuffer::ShmRingBuffer()
+{
+    m_nMapSize = 0;
+    m_nSize = 0;
+    m_eRole = PRODUCER;
+}
+
+ShmRingBuffer::~ShmRingBuffer()
+{
+    close();
+}
+
+bool ShmRingBuffer::open(const char *szName, uint32_t nSize, int eRole)
+{
+    close();
+
+    if(nSize && !is_power_of_two(nSize))
+        nSize = roundup_pow_of_two(nSize);
+
+    bool bOk = false;
+    bool bCreated = false;
+    int fd = nSize ? shm_open(szName, O_RDWR | O_CREAT | O_EXCL, 0600) : -1;
+
+    if(fd >= 0)
+        bCreated = true;
+    else if(!nSize || errno == EEXIST)
+        fd = shm_open(szName, O_RDWR, 0);
+
+    if(fd >= 0)
+        bOk = setup(fd, nSize);
+
+    //自己创建的共享内存没有初始化成功就删掉, 不留下没有nMagic的段
+    if(!bOk && bCreated)
+        shm_unlink(szName);
+
+    //映射建立后就不再需要fd
+    if(fd >= 0)
+        ::close(fd);
+
+    if(bOk && nSize && nSize != m_nSize)
+        bOk = false;
+
+    m_eRole = eRole;
+
+    if(bOk) {
+        if(eRole == PRODUCER)
+            bOk = claim(m_pHeader->nProducerPid, m_pHeader->nProducerStart, m_pHeader->nProducerGen);
+        else
+            bOk = claim(m_pHeader->nConsumerPid, m_pHeader->nConsumerStart, m_pHeader->nConsumerGen);
+    }
+
+    if(!bOk && m_pHeader) {
+        munmap(m_pHeader, m_nMapSize);
+        m_pHeader = NULL;
+        m_pBuffer = NULL;
+    }
+
+    return bOk;
+}
+
+bool ShmRingBuffer::setup(int fd, uint32_t nSize)
+{
+    for(int i = 0; i < 100; i++) {
+        //持有flock时初始化或者接入: 拿到锁时没有nMagic, 说明没人初始化过或者初始化的进程崩溃了
+        //不支持flock时退化为等待, 等了1秒还没有nMagic才当作残留的段重新初始化
+        bool bLocked = flock(fd, LOCK_EX) == 0;
+
+        int nRet = attach(fd);
+        if(!nRet && nSize && (bLocked || i == 99))
+            nRet = init(fd, nSize) ? 1 : -1;
+
+        if(bLocked)
+            flock(fd, LOCK_UN);
+
+        if(nRet)
+            return nRet > 0;
+
+        //只打开不创建: 创建者可能还没拿到锁, 等一会儿再看
+        usleep(10000);
+    }
+
+    return false;
+}
+
+bool ShmRingBuffer::init(int fd, uint32_t nSize)
+{
+    size_t nPage = (size_t)sysconf(_SC_PAGESIZE);
+    size_t nOffset = (sizeof(ShmRingHeader) + nPage - 1) / nPage * nPage;
+
+    m_nMapSize = nOffset + nSize;
+    if(ftruncate(fd, (off_t)m_nMapSize) != 0)
+        return false;
+
+    void *p = mmap(NULL, m_nMapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(p == MAP_FAILED)
+        return false;
+
+    //ftruncate出来的内存全是0, 原子变量不需要再构造; 重新初始化残留的段时头部可能有半截内容, 先清掉
+    memset(p, 0, sizeof(ShmRingHeader));
+    m_pHeader = (ShmRingHeader*)p;
+    m_pHeader->nVersion = SHMRING_VERSION;
+    m_pHeader->nSize = nSize;
+    m_pHeader->nDataOffset = (uint32_t)nOffset;
+    m_pHeader->nMagic.store(SHMRING_MAGIC, std::memory_order_release);
+
+    m_pBuffer = (uint8_t*)p + nOffset;
+    m_nSize = nSize;
+
+    return true;
+}
+
+//已经初始化好的共享内存映射进来; 返回1成功, 0还没有初始化(没有nMagic), -1打不开或者内容无效
+int ShmRingBuffer::attach(int fd)
+{
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+        return -1;
+
+    if((size_t)st.st_size < sizeof(ShmRingHeader))
+        return 0;
+
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(p == MAP_FAILED)
+        return -1;
+
+    ShmRingHeader *pHeader = (ShmRingHeader*)p;
+    if(pHeader->nMagic.load(std::memory_order_acquire) != SHMRING_MAGIC) {
+        munmap(p, (size_t)st.st_size);
+        return 0;
+    }
+
+    if(pHeader->nVersion != SHMRING_VERSION ||
+       !is_power_of_two(pHeader->nSize) ||
+       (size_t)pHeader->nDataOffset + pHeader->nSize > (size_t)st.st_size) {
+        munmap(p, (size_t)st.st_size);
+        return -1;
+    }
+
+    m_pHeader = pHeader;
+    m_pBuffer = (uint8_t*)p + pHeader->nDataOffset;
+    m_nMapSize = (size_t)st.st_size;
+    m_nSize = pHeader->nSize;
+    return 1;
+}
+
+bool ShmRingBuffer::claim(std::atomic<uint32_t> &pid, std::atomic<uint32_t> &start, std::atomic<uint32_t> &gen)
+{
+    uint32_t nSelf = (uint32_t)getpid();
+    uint32_t nOwner = pid.load(std::memory_order_acquire);
+
+    for(;;) {
+        //角色被活着的进程占用
+        if(nOwner == nSelf || process_alive(nOwner, start.load(std::memory_order_acquire)))
+            return false;
+
+        //空闲或者原来的进程已经崩溃, 接管
+        if(pid.compare_exchange_weak(nOwner, nSelf, std::memory_order_acq_rel))
+            break;
+    }
+
+    //CAS之后才写启动时间, 中间这一小段别人看到的是0, 只按pid判断
+    start.store(process_start(nSelf), std::memory_order_release);
+
+    gen.fetch_add(1, std::memory_order_acq_rel);
+
+    return true;
+}
+
+void ShmRingBuffer::close()
+{
+    if(!m_pHeader)
+        return;
+
+    uint32_t nSelf = (uint32_t)getpid();
+    std::atomic<uint32_t> &pid = m_eRole == PRODUCER ? m_pHeader->nProducerPid : m_pHeader->nConsumerPid;
+    std::atomic<uint32_t> &start = m_eRole == PRODUCER ? m_pHeader->nProducerStart : m_pHeader->nConsumerStart;
+    if(pid.load(std::memory_order_relaxed) == nSelf)
+        start.store(0, std::memory_order_relaxed);
+    pid.compare_exchange_strong(nSelf, 0, std::memory_order_acq_rel);
+
+    munmap(m_pHeader, m_nMapSize);
+    m_pHeader = NULL;
+    m_pBuffer = NULL;
+}
+
+bool ShmRingBuffer::unlink(const char *szName)
+{
+    return shm_unlink(szName) == 0;
+}
+
+bool ShmRingBuffer::wait(std::atomic<uint32_t> &word, uint32_t nValue, std::atomic<uint32_t> &waiting, int nTimeoutMs)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(nTimeoutMs);
+
+    //先置waiting再检查word, 对端先更新word再检查waiting, 两边都是seq_cst, 不会漏掉唤醒
+    waiting.store(1, std::memory_order_seq_cst);
+
+    while(word.load(std::memory_order_seq_cst) == nValue) {
+        long long nRemain = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if(nRemain <= 0)
+            break;
+
+#ifdef __linux__
+        struct timespec ts;
+        ts.tv_sec  = (time_t)(nRemain / 1000000);
+        ts.tv_nsec = (long)(nRemain % 1000000) * 1000;
+        syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAIT, nValue, &ts, NULL, 0);
+#else
+        usleep((useconds_t)min(nRemain, 1000LL));
+#endif
+    }
+
+    waiting.store(0, std::memory_order_relaxed);
+
+    return word.load(std::memory_order_acquire) != nValue;
+}
+
+void ShmRingBuffer::wake(std::atomic<uint32_t> &word, std::atomic<uint32_t> &waiting)
+{
+    if(!waiting.load(std::memory_order_seq_cst))
+        return;
+
+#ifdef __linux__
+    syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#else
+    (void)word;
+#endif
+}
+
+uint32_t ShmRingBuffer::put(const void *pFrom, uint32_t nSize, int nTimeoutMs)
+{
+    assert(m_pHeader && m_eRole == PRODUCER);
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(nTimeoutMs);
+    const uint8_t *pData = (const uint8_t*)pFrom;
+    uint32_t nDone = 0;
+
+    //有多少空间写多少, 没写完并且还没超时就等消费者腾出空间
+    for(;;) {
+        uint32_t nIn  = m_pHeader->nIn.load(std::memory_order_relaxed);
+        uint32_t nOut = m_pHeader->nOut.load(std::memory_order_acquire);
+        uint32_t nLen = min(m_nSize - (nIn - nOut), nSize - nDone);
+
+        if(nLen) {
+            uint32_t nOff  = nIn & (m_nSize - 1);
+            uint32_t nPart = min(nLen, m_nSize - nOff);
+
+            memcpy(m_pBuffer + nOff, pData + nDone, nPart);
+            memcpy(m_pBuffer, pData + nDone + nPart, nLen - nPart);
+
+            //数据拷贝完才发布, 生产者在这之前崩溃不会留下半截数据
+            m_pHeader->nIn.store(nIn + nLen, std::memory_order_seq_cst);
+            wake(m_pHeader->nIn, m_pHeader->nConsumerWaiting);
+
+            nDone += nLen;
+            continue;
+        }
+
+        if(nDone == nSize)
+            break;
+
+        int nRemain = (int)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if(nRemain <= 0 || !wait(m_pHeader->nOut, nOut, m_pHeader->nProducerWaiting, nRemain))
+            break;
+    }
+
+    return nDone;
+}
+
+uint32_t ShmRingBuffer::get(void *pTo, uint32_t nSize, int nTimeoutMs)
+{
+    assert(m_pHeader && m_eRole == CONSUMER);
+
+    uint32_t nOut = m_pHeader->nOut.load(std::memory_order_relaxed);
+    uint32_t nIn  = m_pHeader->nIn.load(std::memory_order_acquire);
+
+    if(nIn == nOut && nTimeoutMs > 0) {
+        wait(m_pHeader->nIn, nIn, m_pHeader->nConsumerWaiting, nTimeoutMs);
+        nIn = m_pHeader->nIn.load(std::memory_order_acquire);
+    }
+
+    uint32_t nLen  = min(nIn - nOut, nSize);
+    uint32_t nOff  = nOut & (m_nSize - 1);
+    uint32_t nPart = min(nLen, m_nSize - nOff);
+
+    memcpy(pTo, m_pBuffer + nOff, nPart);
+    memcpy((uint8_t*)pTo + nPart, m_pBuffer, nLen - nPart);
+
+    if(nLen) {
+        m_pHeader->nOut.store(nOut + nLen, std::memory_order_seq_cst);
+        wake(m_pHeader->nOut, m_pHeader->nProducerWaiting);
+    }
+
+    return nLen;
+}
+
+uint32_t ShmRingBuffer::length()
+{
+    assert(m_pHeader);
+
+    uint32_t nOut = m_pHeader->nOut.load(std::memory_order_acquire);
+    uint32_t nIn  = m_pHeader->nIn.load(std::memory_order_acquire);
+
+    return nIn - nOut;
+}
+
+bool ShmRingBuffer::peerAlive()
+{
+    assert(m_pHeader);
+
+    std::atomic<uint32_t> &pid = m_eRole == PRODUCER ? m_pHeader->nConsumerPid : m_pHeader->nProducerPid;
+    std::atomic<uint32_t> &start = m_eRole == PRODUCER ? m_pHeader->nConsumerStart : m_pHeader->nProducerStart;
+
+    return process_alive(pid.load(std::memory_order_acquire), start.load(std::memory_order_acquire));
+}
+
+uint32_t ShmRingBuffer::producerGeneration()
+{
+    assert(m_pHeader);
+
+    return m_pHeader->nProducerGen.load(std::memory_order_acquire);
+}
+
+#endif // _WIN32
@@ -0,0 +1,100 @@
+#ifndef SHMRINGBUFFER_H
+#define SHMRINGBUFFER_H
+
+#ifndef _WIN32
+
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+#include <atomic>
+
+#include "ringutil.h"
+
+#define SHMRING_MAGIC   0x474E4952U //"RING"
+#define SHMRING_VERSION 2
+
+//放在共享内存开头的头部, 后面紧跟数据区
+//索引和pid都是无锁的32位原子变量, 在不同进程的映射地址上同样有效
+struct ShmRingHeader
+{
+    std::atomic<uint32_t> nMagic;   //初始化完成后最后写入
+    uint32_t nVersion;
+    uint32_t nSize;
+    uint32_t nDataOffset;
+
+    char pad0[RING_CACHELINE_SIZE];
+
+    std::atomic<uint32_t> nIn;
+    std::atomic<uint32_t> nProducerPid;     //0表示没有生产者
+    std::atomic<uint32_t> nProducerGen;     //每次生产者接入加1, 消费者据此发现生产者重启
+    std::atomic<uint32_t> nProducerWaiting; //生产者在等空间
+    std::atomic<uint32_t> nProducerStart;   //生产者进程的启动时间, 和pid一起判断进程是否还在(防pid复用)
+
+    char pad1[RING_CACHELINE_SIZE];
+
+    std::atomic<uint32_t> nOut;
+    std::atomic<uint32_t> nConsumerPid;
+    std::atomic<uint32_t> nConsumerGen;
+    std::atomic<uint32_t> nConsumerWaiting; //消费者在等数据
+    std::atomic<uint32_t> nConsumerStart;
+
+    char pad2[RING_CACHELINE_SIZE];
+};
+
+//跨进程的单生产者/单消费者环形缓冲区, 存放在POSIX命名共享内存中
+//崩溃恢复: 索引只在数据拷贝完之后才发布, 所以[nOut, nIn)总是完整的;
+//对端进程退出后新进程可以接管它的角色, 从原来的索引继续(消费者接管时未consume的数据会再读一次)
+class ShmRingBuffer
+{
+public:
+    enum Role
+    {
+        PRODUCER = 0,
+        CONSUMER = 1,
+    };
+
+    ShmRingBuffer();
+    ~ShmRingBuffer();
+
+    ShmRingBuffer(const ShmRingBuffer&) = delete;
+    ShmRingBuffer& operator=(const ShmRingBuffer&) = delete;
+
+    //打开名为szName("/xxx")的共享内存, 不存在时按nSize创建; nSize为0表示只打开已有的
+    //同一角色已经被活着的进程占用时失败
+    bool open(const char *szName, uint32_t nSize, int eRole);
+    //放弃角色并解除映射, 不删除共享内存
+    void close();
+    static bool unlink(const char *szName);
+
+    //生产者: 写入能放下的部分, nTimeoutMs > 0时空间不够会等待, 返回写入的字节数
+    uint32_t put(const void *pFrom, uint32_t nSize, int nTimeoutMs = 0);
+    //消费者: 读出已有的数据, nTimeoutMs > 0时为空会等待, 返回读出的字节数
+    uint32_t get(void *pTo, uint32_t nSize, int nTimeoutMs = 0);
+
+    uint32_t length();
+    uint32_t size() { return m_nSize; }
+
+    //对端进程是否还在(正常close或者崩溃都算不在)
+    bool peerAlive();
+    //生产者接入的次数, 变化说明生产者重启过
+    uint32_t producerGeneration();
+
+private:
+    bool setup(int fd, uint32_t nSize);
+    bool init(int fd, uint32_t nSize);
+    int attach(int fd);
+    bool claim(std::atomic<uint32_t> &pid, std::atomic<uint32_t> &start, std::atomic<uint32_t> &gen);
+    bool wait(std::atomic<uint32_t> &word, uint32_t nValue, std::atomic<uint32_t> &waiting, int nTimeoutMs);
+    void wake(std::atomic<uint32_t> &word, std::atomic<uint32_t> &waiting);
+
+private:
+    ShmRingHeader *m_pHeader = NULL;
+    uint8_t  *m_pBuffer = NULL;
+    size_t   m_nMapSize;
+    uint32_t m_nSize;
+    int      m_eRole;
+};
+
+#endif // _WIN32
+
+#endif // SHMRINGBUFFER_H
@@ -0,0 +1,150 @@
+/*
+ * =====================================================================================
+ *       Filename:  spscringbuffer.cpp
+ *
+ *    Description:  单生产者/单消费者无锁环形缓冲区
+ *         Others:  1.与RingBuffer相同: 2的次方大小, (in) & (size - 1)求偏移, unsigned int回环.
+ *                  2.生产者只写m_nIn, 消费者只写m_nOut; 先拷贝数据再release发布索引,
+ *                    对端acquire读到索引后数据一定可见.
+ *                  3.各端缓存对端索引, 只有缓存值不够用时才去读对端缓存行.
+ * =====================================================================================
+ */
+
+#include "spscringbuffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//取a和b中最小值
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+
+SpscRingBuffer::SpscRingBuffer(uint32_t nSize, uint32_t nFlags)
+{
+    if(!is_power_of_two(nSize))
+        nSize = roundup_pow_of_two(nSize);
+
+    ring_alloc(&m_memory, nSize, nFlags);
+    m_pBuffer = m_memory.pBuffer;
+
+    assert(m_pBuffer);
+
+    m_nSize = m_memory.nSize;
+    m_bMirrored = (m_memory.nFlags & RING_ALLOC_MIRRORED) != 0;
+    m_nIn.store(0, std::memory_order_relaxed);
+    m_nOut.store(0, std::memory_order_relaxed);
+    m_nOutCache = m_nInCache = 0;
+}
+
+SpscRingBuffer::~SpscRingBuffer()
+{
+    if(m_pBuffer) {
+        ring_free(&m_memory);
+        m_pBuffer = NULL;
+    }
+}
+
+uint32_t SpscRingBuffer::put(const void *pFrom, uint32_t nSize)
+{
+    uint32_t nIn = m_nIn.load(std::memory_order_relaxed);
+    uint32_t nLen, nOff;
+
+    //先用缓存的读索引计算剩余空间, 不够再去取最新值
+    if(m_nSize - (nIn - m_nOutCache) < nSize)
+        m_nOutCache = m_nOut.load(std::memory_order_acquire);
+
+    nSize = min(m_nSize - (nIn - m_nOutCache), nSize);
+    if(!nSize)
+        return 0;
+
+    nOff = nIn & (m_nSize - 1);
+    nLen = m_bMirrored ? nSize : min(nSize, m_nSize - nOff);
+
+    memcpy(m_pBuffer + nOff, pFrom, nLen);
+    memcpy(m_pBuffer, (const uint8_t*)pFrom + nLen, nSize - nLen);
+
+    //数据写完后再发布写索引
+    m_nIn.store(nIn + nSize, std::memory_order_release);
+
+    return nSize;
+}
+
+uint32_t SpscRingBuffer::get(void *pTo, uint32_t nSize)
+{
+    uint32_t nOut = m_nOut.load(std::memory_order_relaxed);
+    uint32_t nLen, nOff;
+
+    if(m_nInCache - nOut < nSize)
+        m_nInCache = m_nIn.load(std::memory_order_acquire);
+
+    nSize = min(m_nInCache - nOut, nSize);
+    if(!nSize)
+        return 0;
+
+    nOff = nOut & (m_nSize - 1);
+    nLen = m_bMirrored ? nSize : min(nSize, m_nSize - nOff);
+
+    memcpy(pTo, m_pBuffer + nOff, nLen);
+    memcpy((uint8_t*)pTo + nLen, m_pBuffer, nSize - nLen);
+
+    //数据读完后再释放空间给生产者
+    m_nOut.store(nOut + nSize, std::memory_order_release);
+
+    return nSize;
+}
+
+uint32_t SpscRingBuffer::reserve(uint32_t nSize, RingSpan aSpan[2])
+{
+    uint32_t nIn = m_nIn.load(std::memory_order_relaxed);
+
+    if(m_nSize - (nIn - m_nOutCache) < nSize)
+        m_nOutCache = m_nOut.load(std::memory_order_acquire);
+
+    nSize = min(m_nSize - (nIn - m_nOutCache), nSize);
+
+    return ring_spans(m_pBuffer, m_nSize, nIn, nSize, aSpan, m_bMirrored);
+}
+
+void SpscRingBuffer::commit(uint32_t nSize)
+{
+    uint32_t nIn = m_nIn.load(std::memory_order_relaxed);
+
+    assert(nSize <= m_nSize - (nIn - m_nOutCache));
+
+    m_nIn.store(nIn + nSize, std::memory_order_release);
+}
+
+uint32_t SpscRingBuffer::peek(RingSpan aSpan[2])
+{
+    uint32_t nOut = m_nOut.load(std::memory_order_relaxed);
+
+    m_nInCache = m_nIn.load(std::memory_order_acquire);
+
+    return ring_spans(m_pBuffer, m_nSize, nOut, m_nInCache - nOut, aSpan, m_bMirrored);
+}
+
+void SpscRingBuffer::consume(uint32_t nSize)
+{
+    uint32_t nOut = m_nOut.load(std::memory_order_relaxed);
+
+    assert(nSize <= m_nInCache - nOut);
+
+    m_nOut.store(nOut + nSize, std::memory_order_release);
+}
+
+uint32_t SpscRingBuffer::length()
+{
+    uint32_t nOut = m_nOut.load(std::memory_order_acquire);
+    uint32_t nIn  = m_nIn.load(std::memory_order_acquire);
+
+    return nIn - nOut;
+}
+
+uint32_t SpscRingBuffer::head()
+{
+    return m_nIn.load(std::memory_order_acquire) & (m_nSize - 1);
+}
+
+uint32_t SpscRingBuffer::tail()
+{
+    return m_nOut.load(std::memory_order_acquire) & (m_nSize - 1);
+}
@@ -0,0 +1,68 @@
+#ifndef SPSCRINGBUFFER_H
+#define SPSCRINGBUFFER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+#include <atomic>
+
+#include "ringutil.h"
+#include "ringmemory.h"
+
+//单生产者/单消费者无锁环形缓冲区
+//put只能在一个生产者线程调用, get只能在一个消费者线程调用
+//索引用acquire/release发布, 读写索引分别独占缓存行
+class SpscRingBuffer
+{
+public:
+    //nFlags为RingAllocFlag, RING_ALLOC_MIRRORED时读写区域总是连续的一段
+    SpscRingBuffer(uint32_t nSize, uint32_t nFlags = RING_ALLOC_HEAP);
+    ~SpscRingBuffer();
+
+    SpscRingBuffer(const SpscRingBuffer&) = delete;
+    SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+    //生产者线程: 写入min(剩余空间, nSize)字节, 不阻塞
+    uint32_t put(const void *pFrom, uint32_t nSize);
+    //消费者线程: 读出min(已有数据, nSize)字节, 不阻塞, 为空返回0
+    uint32_t get(void *pTo, uint32_t nSize);
+
+    //生产者线程: 零拷贝写, reserve返回最多nSize字节的空闲空间(最多两段), 写好后commit
+    uint32_t reserve(uint32_t nSize, RingSpan aSpan[2]);
+    void commit(uint32_t nSize);
+
+    //消费者线程: 零拷贝读, peek返回当前所有可读数据(最多两段), 用完后consume释放
+    uint32_t peek(RingSpan aSpan[2]);
+    void consume(uint32_t nSize);
+
+    uint32_t length();
+    uint32_t size() { return m_nSize; }
+
+    //存储是否为镜像映射(可能因为系统不支持而退回到普通堆内存)
+    bool mirrored() { return m_bMirrored; }
+
+    uint32_t head();
+    uint32_t tail();
+
+private:
+    uint8_t  *m_pBuffer = NULL;
+    uint32_t m_nSize;
+    bool     m_bMirrored;
+    RingMemory m_memory;
+
+    char m_pad0[RING_CACHELINE_SIZE];
+
+    //生产者独占: 写索引及其缓存的读索引
+    std::atomic<uint32_t> m_nIn;
+    uint32_t m_nOutCache;
+
+    char m_pad1[RING_CACHELINE_SIZE];
+
+    //消费者独占: 读索引及其缓存的写索引
+    std::atomic<uint32_t> m_nOut;
+    uint32_t m_nInCache;
+
+    char m_pad2[RING_CACHELINE_SIZE];
+};
+
+#endif // SPSCRINGBUFFER_H
@@ -0,0 +1,19 @@
+#ifndef STATICRINGBUFFER_H
+#define STATICRINGBUFFER_H
+
+#include <stdint.h>
+
+#include "basicringbuffer.h"
+
+//编译期确定大小的环形缓冲区, 存储内嵌在对象里, 不做任何堆分配, 可以直接放进数组或者对象池
+//大小和掩码都是常量, 编译器可以把取模折叠掉, 小块拷贝可以展开
+//实现和BasicRingBuffer共用(RingBufferCore), 不支持镜像映射
+//大小只有一个来源: RingBufferCore每次从RingInlineStorage<N>::size()取, 它是constexpr, 不另外存运行时的大小和掩码
+template <uint32_t N>
+class StaticRingBuffer : public RingBufferCore<uint32_t, RingInlineStorage<N> >
+{
+public:
+    StaticRingBuffer() {}
+};
+
+#endif // STATICRINGBUFFER_H